@@ -11,6 +11,12 @@ Rover::RoverStatus::RoverStatus()
     : mCurrentState( NavState::Off )
 {
     mAutonState.is_auton = false;
+    mObstacle = {};
+    mObstacle.distance = -1;
+    mTarget1 = {};
+    mTarget1.distance = -1;
+    mTarget1.id = -1;
+    mTarget2 = mTarget1;
 } // RoverStatus()
 
 // Gets a reference to the rover's current navigation state.
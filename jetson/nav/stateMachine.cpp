@@ -100,6 +100,7 @@ void StateMachine::updateObstacleElements( double bearing, double distance )
 void StateMachine::run()
 {
     publishNavState();
+    expireStaleDetections();
     if( isRoverReady() )
     {
         mStateChanged = false;
@@ -258,23 +259,75 @@ void StateMachine::updateRoverStatus( Course course )
     }
 } // updateRoverStatus( Course )
 
-// Updates the obstacle information of the rover's status.
+// Updates the obstacle information of the rover's status. The bearings
+// are corrected by how far the rover has turned since the obstacle was
+// seen. An obstacle that is already too old is expired by the next run.
 void StateMachine::updateRoverStatus( Obstacle obstacle )
 {
+    double turned;
+    // A clear path keeps its bearings of 0.
+    if( isDetectionFresh( obstacle.timestamp, turned ) && obstacle.distance >= 0 )
+    {
+        obstacle.bearing -= turned;
+        obstacle.rightBearing -= turned;
+    }
     mNewRoverStatus.obstacle() = obstacle;
 } // updateRoverStatus( Obstacle )
 
-// Updates the odometry information of the rover's status.
+// Updates the odometry information of the rover's status. The heading
+// is kept for long enough to tell where the rover was facing when any
+// detection that isn't too old was captured.
 void StateMachine::updateRoverStatus( Odometry odometry )
 {
     mNewRoverStatus.odometry() = odometry;
+
+    const int64_t now = microsecondsSinceEpoch();
+    const double maxAge = mRoverConfig[ "computerVision" ][ "maxDetectionAge" ].GetDouble();
+    mHeadingHistory.emplace_back( now, odometry.bearing_deg );
+    while( mHeadingHistory.size() > 1 &&
+           now - mHeadingHistory[ 1 ].first > maxAge * MICROSECONDS_PER_SECOND )
+    {
+        mHeadingHistory.pop_front();
+    }
 } // updateRoverStatus( Odometry )
 
-// Updates the target information of the rover's status.
+// Updates the target information of the rover's status. The first
+// target is the leftmost tag seen and the second is the rightmost tag
+// on a different post, since a post can show more than one tag.
+// Targets that weren't seen have a distance and id of -1. Bearings are
+// corrected like the obstacle's, and targets that are already too old
+// are expired by the next run.
 void StateMachine::updateRoverStatus( TargetList targetList )
 {
-    Target target1 = targetList.targetList[0];
-    Target target2 = targetList.targetList[1];
+    double turned;
+    isDetectionFresh( targetList.timestamp, turned );
+    mTargetCaptureTime = targetList.timestamp;
+
+    Target target1 = {};
+    Target target2 = {};
+    target1.distance = target2.distance = -1;
+    target1.id = target2.id = -1;
+
+    if( targetList.num_targets > 0 )
+    {
+        target1 = targetList.targetList[ 0 ];
+        for( int i = targetList.num_targets - 1; i > 0; --i )
+        {
+            if( targetList.targetList[ i ].id != target1.id )
+            {
+                target2 = targetList.targetList[ i ];
+                break;
+            }
+        }
+    }
+    if( target1.id != -1 )
+    {
+        target1.bearing -= turned;
+    }
+    if( target2.id != -1 )
+    {
+        target2.bearing -= turned;
+    }
     mNewRoverStatus.target() = target1;
     mNewRoverStatus.target2() = target2;
 } // updateRoverStatus( Target )
@@ -285,6 +338,64 @@ void StateMachine::updateRoverStatus( RadioSignalStrength radioSignalStrength )
     mNewRoverStatus.radio() = radioSignalStrength;
 } // updateRoverStatus( RadioSignalStrength )
 
+// Returns false if a detection from a frame captured at captureTime is
+// too old to act on. Otherwise sets turned to how many degrees the rover
+// has turned clockwise since then, so bearings from the frame can be
+// brought up to date. Messages with no timestamp are taken as current.
+bool StateMachine::isDetectionFresh( const int64_t captureTime, double& turned ) const
+{
+    turned = 0;
+    if( captureTime == 0 )
+    {
+        return true;
+    }
+
+    const double maxAge = mRoverConfig[ "computerVision" ][ "maxDetectionAge" ].GetDouble();
+    if( microsecondsSinceEpoch() - captureTime > maxAge * MICROSECONDS_PER_SECOND )
+    {
+        return false;
+    }
+    if( mHeadingHistory.empty() )
+    {
+        return true;
+    }
+
+    // The rover faced the last heading that arrived before the capture.
+    double captureHeading = mHeadingHistory.front().second;
+    for( const pair<int64_t, double>& heading : mHeadingHistory )
+    {
+        if( heading.first > captureTime )
+        {
+            break;
+        }
+        captureHeading = heading.second;
+    }
+    turned = mod( mHeadingHistory.back().second - captureHeading + 180, 360 ) - 180;
+    return true;
+} // isDetectionFresh()
+
+// Forgets the obstacle and targets once the frames they were seen in are
+// too old to act on, so nav doesn't keep acting on the last detection if
+// perception stops publishing or falls behind.
+void StateMachine::expireStaleDetections()
+{
+    double turned;
+    Obstacle& obstacle = mNewRoverStatus.obstacle();
+    if( !isDetectionFresh( obstacle.timestamp, turned ) )
+    {
+        obstacle.bearing = 0;
+        obstacle.rightBearing = 0;
+        obstacle.distance = -1;
+    }
+    if( !isDetectionFresh( mTargetCaptureTime, turned ) )
+    {
+        mNewRoverStatus.target().distance = -1;
+        mNewRoverStatus.target().id = -1;
+        mNewRoverStatus.target2().distance = -1;
+        mNewRoverStatus.target2().id = -1;
+    }
+} // expireStaleDetections()
+
 // Return true if we want to execute a loop in the state machine, false
 // otherwise.
 bool StateMachine::isRoverReady() const
@@ -1,6 +1,8 @@
 #ifndef STATE_MACHINE_HPP
 #define STATE_MACHINE_HPP
 
+#include <deque>
+#include <utility>
 #include <lcm/lcm-cpp.hpp>
 #include "rapidjson/document.h"
 #include "rover.hpp"
@@ -93,6 +95,10 @@ private:
 
     void addRepeaterDropPoint();
 
+    bool isDetectionFresh( const int64_t captureTime, double& turned ) const;
+
+    void expireStaleDetections();
+
     /*************************************************************************/
     /* Private Member Variables */
     /*************************************************************************/
@@ -126,6 +132,13 @@ private:
     // Avoidance pointer to control obstacle avoidance states
     ObstacleAvoidanceStateMachine* mObstacleAvoidanceStateMachine;
 
+    // Recent rover headings, oldest first, each with the time it arrived
+    // in microseconds since the epoch.
+    deque<pair<int64_t, double>> mHeadingHistory;
+
+    // When the frame the held targets came from was captured, 0 if unknown.
+    int64_t mTargetCaptureTime = 0;
+
 }; // StateMachine
 
 #endif // STATE_MACHINE_HPP
@@ -1,6 +1,7 @@
 #include "utilities.hpp"
 #include <iostream> // remove
 #include <cmath>
+#include <chrono>
 
 // Coverts the input degree (and optional minute) to radians.
 double degreeToRadian( const double degree, const double minute )
@@ -122,6 +123,14 @@ void clear( deque<Waypoint>& aDeque )
     swap( aDeque, emptyDeque );
 } // clear()
 
+// Returns the current time in microseconds since the epoch, the clock
+// perception stamps its frames with.
+int64_t microsecondsSinceEpoch()
+{
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::system_clock::now().time_since_epoch() ).count();
+} // microsecondsSinceEpoch()
+
 
 // Checks to see if target is reachable before hitting obstacle
 // If the x component of the distance to obstacle is greater than
@@ -13,6 +13,7 @@ const int EARTH_RADIUS = 6371000; // meters
 const int EARTH_CIRCUM = 40075000; // meters
 const double PI = 3.141592654; // radians
 const double LAT_METER_IN_MINUTES = 0.0005389625; // minutes/meters
+const double MICROSECONDS_PER_SECOND = 1000000;
 
 double degreeToRadian( const double degree, const double minute = 0 );
 
@@ -32,6 +33,8 @@ void throughZero( double& destinationBearing, const double currentBearing );
 
 void clear( deque<Waypoint>& aDeque );
 
+int64_t microsecondsSinceEpoch();
+
 bool isTargetReachable( Rover* rover, const rapidjson::Document& roverConfig );
 
 bool isLocationReachable( Rover* rover, const rapidjson::Document& roverConfig, const double locDist, const double distThresh );
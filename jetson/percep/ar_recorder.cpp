@@ -0,0 +1,89 @@
+#include "ar_recorder.hpp"
+#include <iostream>
+
+ArRecorder::ArRecorder(const std::string &path, int fourcc, double fps, size_t ringSize, DropPolicy policy) :
+    path{path}, fourcc{fourcc}, fps{fps}, policy{policy},
+    period{std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps))},
+    nextFrame{std::chrono::steady_clock::now()}, ring{ringSize}, stopping{false}, dropped{0},
+    encoder{&ArRecorder::run, this} {}
+
+ArRecorder::~ArRecorder() {
+    finish();
+}
+
+bool ArRecorder::record(const cv::Mat &frame) {
+    //Keep the video at its frame rate no matter how fast detection runs
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextFrame) {
+        return true;
+    }
+    nextFrame = std::max(nextFrame + period, now);
+
+    cv::Mat *slot = ring.acquire();
+    if (!slot) {
+        ++dropped;
+        return false;
+    }
+
+    //The slot keeps its buffer between laps of the ring so this only allocates on the first lap
+    frame.copyTo(*slot);
+    ring.publish();
+    return true;
+}
+
+void ArRecorder::finish() {
+    if (!encoder.joinable()) {
+        return;
+    }
+    stopping.store(true);
+    encoder.join();
+
+    if (dropped.load()) {
+        std::cerr << "AR recording dropped " << dropped.load() << " frames, the encoder couldn't keep up\n";
+    }
+}
+
+void ArRecorder::run() {
+    //Polls at a few times the frame rate so the ring never sits full for long
+    const auto idle = period / 4;
+    bool failed = false;
+    while (true) {
+        //Read before checking the ring so no frame published before finish() is missed
+        bool done = stopping.load();
+        cv::Mat *frame = ring.front();
+        if (!frame) {
+            if (done) {
+                break;
+            }
+            std::this_thread::sleep_for(idle);
+            continue;
+        }
+
+        if (policy == KEEP_LATEST) {
+            while (ring.size() > 1) {
+                ring.release();
+                ++dropped;
+            }
+            frame = ring.front();
+        }
+
+        //The size of the video is only known once the first frame comes in
+        if (!writer.isOpened() && !failed) {
+            writer.open(path, fourcc, fps, frame->size(), true);
+            if (!writer.isOpened()) {
+                std::cerr << "ar record didn't open\n";
+                failed = true;
+            }
+        }
+        if (failed) {
+            //Keep draining so record() never sees a full ring
+            ring.release();
+            ++dropped;
+            continue;
+        }
+
+        writer.write(*frame);
+        ring.release();
+    }
+    writer.release();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "spsc_ring.hpp"
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+/* --- AR Recorder --- */
+/**
+\brief Records the annotated AR tag frames to a video on its own thread
+record() copies the frame into a preallocated ring slot and returns, the
+encoder thread drains the ring into a cv::VideoWriter that it opens with
+the size of the first frame. Frames arriving faster than fps are skipped.
+When encoding falls behind the drop policy decides what gives:
+DROP_NEWEST keeps every queued frame and drops new ones while the ring is
+full, KEEP_LATEST has the encoder skip to the most recent queued frame so
+the video stays current
+*/
+class ArRecorder {
+public:
+    enum DropPolicy {
+        DROP_NEWEST,
+        KEEP_LATEST
+    };
+
+    ArRecorder(const std::string &path, int fourcc, double fps, size_t ringSize, DropPolicy policy);
+    ~ArRecorder();
+
+    //Queues a copy of frame for encoding, returns false if it was dropped
+    bool record(const cv::Mat &frame);
+
+    //Encodes what is left in the ring and closes the video
+    void finish();
+
+    size_t droppedFrames() const { return dropped.load(); }
+
+private:
+    void run();
+
+    std::string path;
+    int fourcc;
+    double fps;
+    DropPolicy policy;
+
+    //Frames go out no more often than once every period
+    std::chrono::steady_clock::duration period;
+    std::chrono::steady_clock::time_point nextFrame;
+
+    SpscRing<cv::Mat> ring;
+    cv::VideoWriter writer;
+    std::atomic<bool> stopping;
+    std::atomic<size_t> dropped;
+    std::thread encoder;
+};
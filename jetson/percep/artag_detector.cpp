@@ -24,7 +24,25 @@ TagDetector::TagDetector(const rapidjson::Document &mRoverConfig) :
    DO_CORNER_REFINEMENT{!!mRoverConfig["alvar_params"]["do_corner_refinement"].GetInt()},
    POLYGONAL_APPROX_ACCURACY_RATE{mRoverConfig["alvar_params"]["polygonal_approx_accuracy_rate"].GetDouble()},
    MM_PER_M{mRoverConfig["mm_per_m"].GetInt()},
-   DEFAULT_TAG_VAL{mRoverConfig["ar_tag"]["default_tag_val"].GetInt()} {
+   DEFAULT_TAG_VAL{mRoverConfig["ar_tag"]["default_tag_val"].GetInt()},
+   ROI_TRACKING{!!mRoverConfig["ar_tag"]["roi"]["tracking"].GetInt()},
+   ROI_FULL_SCAN_INTERVAL{mRoverConfig["ar_tag"]["roi"]["full_scan_interval"].GetInt()},
+   ROI_MARGIN{mRoverConfig["ar_tag"]["roi"]["margin"].GetDouble()},
+   ROI_UPSCALE{mRoverConfig["ar_tag"]["roi"]["upscale"].GetDouble()},
+   ROI_UPSCALE_BELOW{mRoverConfig["ar_tag"]["roi"]["upscale_below_px"].GetInt()},
+   PYRAMID_SEARCH{!!mRoverConfig["ar_tag"]["pyramid"]["enabled"].GetInt()},
+   PYRAMID_SCALE{mRoverConfig["ar_tag"]["pyramid"]["scale"].GetDouble()},
+   PYRAMID_MARGIN{mRoverConfig["ar_tag"]["pyramid"]["margin"].GetDouble()},
+   RANGE_MIN_CONFIDENCE{mRoverConfig["ar_tag"]["range"]["min_confidence"].GetDouble()},
+   MARKER_LENGTH{mRoverConfig["ar_tag"]["marker_length"].GetDouble()},
+   cameraModel{mRoverConfig},
+   rangeEstimator{mRoverConfig["ar_tag"]["range"]["quad_shrink"].GetDouble(),
+                  mRoverConfig["ar_tag"]["range"]["trim"].GetDouble(),
+                  mRoverConfig["ar_tag"]["range"]["tolerance"].GetDouble()},
+   tagTracker{mRoverConfig["ar_tag"]["tracker"]["alpha"].GetDouble(),
+              mRoverConfig["ar_tag"]["tracker"]["beta"].GetDouble(),
+              mRoverConfig["ar_tag"]["tracker"]["rate_decay"].GetDouble(),
+              BUFFER_ITERATIONS} {
 
     cv::FileStorage fsr("jetson/percep/alvar_dict.yml", cv::FileStorage::READ);
     if (!fsr.isOpened()) {  //throw error if dictionary file does not exist
@@ -62,18 +80,55 @@ Point2f TagDetector::getAverageTagCoordinateFromCorners(const vector<Point2f> &c
     return avgCoord;
 }
 
-pair<Tag, Tag> TagDetector::findARTags(Mat &src, Mat &depth_src, Mat &rgb) {  //detects AR tags in source Mat and outputs Tag objects for use in LCM
+vector<Tag> TagDetector::findARTags(Mat &src, Mat &depth_src, Mat &rgb) {  //detects AR tags in source Mat and outputs Tag objects for use in LCM
     // RETURN:
-    // pair of target objects- each object has an x and y for the center,
-    // and the tag ID number return them such that the "leftmost" (x
-    // coordinate) tag is at index 0
-    cvtColor(src, rgb, COLOR_RGBA2RGB);
+    // every detected tag with its center, corners, id and pose,
+    // ordered by x coordinate so the leftmost tag is at index 0
+
+    // work in undistorted pixels so the camera model's matrix and bearing table apply
+    cameraModel.setFrameSize(src.size());
+    if (cameraModel.isDistorted()) {
+        cameraModel.undistort(src, undistortedSrc);
+        cameraModel.undistort(depth_src, undistortedDepth, INTER_NEAREST);
+    }
+    const Mat &image = cameraModel.isDistorted() ? undistortedSrc : src;
+
     // clear ids and corners vectors for each detection
     ids.clear();
     corners.clear();
 
+    // Once tags are found only the areas around them are searched, with a full scan
+    // every ROI_FULL_SCAN_INTERVAL frames to pick up new tags or whenever one is lost
+    bool fullScan = !ROI_TRACKING || tracks.empty() || ++framesSinceFullScan >= ROI_FULL_SCAN_INTERVAL ||
+                    !findTrackedTags(image);
+
+    // While spinning, full scans find candidates on a downscaled frame and only decode those at full resolution
+    bool coarseToFine = fullScan && PYRAMID_SEARCH && coarseSearch;
+    bool fullFrameScan = fullScan && !coarseToFine;
+    if (coarseToFine) {
+        findTagsCoarseToFine(image);
+    }
+
+    // the converted frame is only needed for full frame scans, or to draw on when recording or debugging
+    #if AR_RECORD || PERCEPTION_DEBUG
+    cvtColor(image, rgb, COLOR_RGBA2RGB);
+    #else
+    if (fullFrameScan) {
+        cvtColor(image, rgb, COLOR_RGBA2RGB);
+    }
+    #endif
+
     // Find tags
-    cv::aruco::detectMarkers(rgb, alvarDict, corners, ids, alvarParams);
+    if (fullFrameScan) {
+        ids.clear();
+        corners.clear();
+        cv::aruco::detectMarkers(rgb, alvarDict, corners, ids, alvarParams);
+    }
+    if (fullScan) {
+        framesSinceFullScan = 0;
+    }
+    updateTracks();
+
     #if AR_RECORD
     cv::aruco::drawDetectedMarkers(rgb, corners, ids);
     #endif
@@ -89,92 +144,189 @@ pair<Tag, Tag> TagDetector::findARTags(Mat &src, Mat &depth_src, Mat &rgb) {  //
     setMouseCallback("Obstacle", onMouse);
     #endif
 
+    // estimate the pose of every tag from its corners
+    rvecs.clear();
+    tvecs.clear();
+    if (!ids.empty()) {
+        cv::aruco::estimatePoseSingleMarkers(corners, MARKER_LENGTH, cameraModel.cameraMatrix(), Mat(), rvecs, tvecs);
+    }
+
     // create Tag objects for the detected tags and return them
-    pair<Tag, Tag> discoveredTags;
-    if (ids.size() == 0) {
-        // no tags found, return invalid objects with tag set to -1
-        discoveredTags.first.id = DEFAULT_TAG_VAL;
-        discoveredTags.first.loc = Point2f();
-        discoveredTags.second.id = DEFAULT_TAG_VAL;
-        discoveredTags.second.loc = Point2f();
-
-    } else if (ids.size() == 1) {  // exactly one tag found
-        discoveredTags.first.id = ids[0];
-        discoveredTags.first.loc = getAverageTagCoordinateFromCorners(corners[0]);
-        // set second tag to invalid object with tag as -1
-        discoveredTags.second.id = DEFAULT_TAG_VAL;
-        discoveredTags.second.loc = Point2f();
-    } else if (ids.size() == 2) {  // exactly two tags found
-        Tag t0, t1;
-        t0.id = ids[0];
-        t0.loc = getAverageTagCoordinateFromCorners(corners[0]);
-        t1.id = ids[1];
-        t1.loc = getAverageTagCoordinateFromCorners(corners[1]);
-        if (t0.loc.x < t1.loc.x) {  //if tag 0 is left of tag 1, put t0 first
-            discoveredTags.first = t0;
-            discoveredTags.second = t1;
-        } else {  //tag 1 is left of tag 0, put t1 first
-            discoveredTags.first = t1;
-            discoveredTags.second = t0;
+    vector<Tag> discoveredTags(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        discoveredTags[i].id = ids[i];
+        discoveredTags[i].loc = getAverageTagCoordinateFromCorners(corners[i]);
+        discoveredTags[i].corners = corners[i];
+        discoveredTags[i].rvec = rvecs[i];
+        discoveredTags[i].tvec = tvecs[i];
+    }
+    sort(discoveredTags.begin(), discoveredTags.end(), [](const Tag &a, const Tag &b) {
+        return a.loc.x < b.loc.x;
+    });
+    return discoveredTags;
+}
+
+void TagDetector::setIntrinsics(const CameraIntrinsics &intrinsics) {
+    cameraModel.setIntrinsics(intrinsics);
+}
+
+void TagDetector::findTagsInRois(const Mat &src, double margin) {
+    for (const Rect &roi : rois) {
+        cvtColor(src(roi), roiRgb, COLOR_RGBA2RGB);
+
+        // small tags are scaled up so their bits are still readable
+        double scale = min(roi.width, roi.height) < ROI_UPSCALE_BELOW * (1 + 2 * margin) ? ROI_UPSCALE : 1.0;
+        const Mat *searched = &roiRgb;
+        if (scale != 1.0) {
+            resize(roiRgb, roiScaled, Size(), scale, scale, INTER_LINEAR);
+            searched = &roiScaled;
         }
-    } else {  // detected >=3 tags
-        // return leftmost and rightsmost detected tags to account for potentially seeing 2 of each tag on a post
-        Tag t0, t1;
-        t0.id = ids[0];
-        t0.loc = getAverageTagCoordinateFromCorners(corners[0]);
-        t1.id = ids[ids.size() - 1];
-        t1.loc = getAverageTagCoordinateFromCorners(corners[ids.size() - 1]);
-        if (t0.loc.x < t1.loc.x) {  //if tag 0 is left of tag 1, put t0 first
-            discoveredTags.first = t0;
-            discoveredTags.second = t1;
-        } else {  //tag 1 is left of tag 0, put t1 first
-            discoveredTags.first = t1;
-            discoveredTags.second = t0;
+
+        roiIds.clear();
+        roiCorners.clear();
+        cv::aruco::detectMarkers(*searched, alvarDict, roiCorners, roiIds, alvarParams);
+
+        // map the corners back into the full frame
+        for (size_t i = 0; i < roiIds.size(); ++i) {
+            for (Point2f &corner : roiCorners[i]) {
+                corner = Point2f(corner.x / scale + roi.x, corner.y / scale + roi.y);
+            }
+            ids.push_back(roiIds[i]);
+            corners.push_back(roiCorners[i]);
         }
     }
-    return discoveredTags;
 }
 
-double TagDetector::getAngle(float xPixel, float wPixel){
-    double fieldofView = 110 * PI/180;
-    return atan((xPixel - wPixel/2)/(wPixel/2)* tan(fieldofView/2))* 180.0 /PI;
+namespace {
+    // pads box by margin times its larger side and adds it to rois, clipped to frame
+    void addRoi(vector<Rect> &rois, const Rect &box, double margin, const Rect &frame) {
+        int pad = static_cast<int>(margin * max(box.width, box.height));
+        Rect roi = Rect(box.x - pad, box.y - pad, box.width + 2 * pad, box.height + 2 * pad) & frame;
+        if (!roi.empty()) {
+            rois.push_back(roi);
+        }
+    }
+
+    // merges overlapping regions so no part of the frame is searched twice
+    void mergeRois(vector<Rect> &rois) {
+        for (size_t i = 0; i < rois.size(); ++i) {
+            for (size_t j = i + 1; j < rois.size(); ++j) {
+                if ((rois[i] & rois[j]).area() > 0) {
+                    rois[i] |= rois[j];
+                    rois.erase(rois.begin() + j);
+                    j = i;
+                }
+            }
+        }
+    }
 }
 
-void TagDetector::updateDetectedTagInfo(rover_msgs::Target *arTags, pair<Tag, Tag> &tagPair, Mat &depth_img, Mat &src){
-    struct tagPairs {
-        vector<int> id;
-        vector<int> locx;
-        vector<int> locy;
-        vector<int> buffer;
-    }; 
-    tagPairs tags;
-
-    tags.id.push_back(tagPair.first.id);
-    tags.locx.push_back(tagPair.first.loc.x);
-    tags.locy.push_back(tagPair.first.loc.y);
-    tags.id.push_back(tagPair.second.id);
-    tags.locx.push_back(tagPair.second.loc.x);
-    tags.locy.push_back(tagPair.second.loc.y);
-    tags.buffer.push_back(0);
-    tags.buffer.push_back(0);
-
-  for (uint i=0; i<2; i++) {
-    if(tags.id[i] == DEFAULT_TAG_VAL){ //no tag found
-        if(tags.buffer[i] <= BUFFER_ITERATIONS){ //send buffered tag until tag is found
-            ++tags.buffer[i];
-        } else { //if still no tag found, set all stats to -1
-            arTags[i].distance = DEFAULT_TAG_VAL;
-            arTags[i].bearing = DEFAULT_TAG_VAL;
-            arTags[i].id = DEFAULT_TAG_VAL;
+bool TagDetector::findTrackedTags(const Mat &src) {
+    const Rect frame(0, 0, src.cols, src.rows);
+
+    // predict where each tag is now and pad the box around it by a fraction of its size
+    rois.clear();
+    for (const TrackedTag &track : tracks) {
+        vector<Point2f> predicted = track.corners;
+        for (Point2f &corner : predicted) {
+            corner += track.velocity;
         }
-     } else { //tag found
-    if(!isnan(depth_img.at<float>(tags.locy.at(i), tags.locx.at(i)))) {
-        arTags[i].distance = depth_img.at<float>(tags.locy.at(i), tags.locx.at(i)) / MM_PER_M;
-    }
-        arTags[i].bearing = getAngle((int)tags.locx.at(i), src.cols);
-        arTags[i].id = tags.id.at(i);
-        tags.buffer[i] = 0;
-   }
-  }
+        addRoi(rois, boundingRect(predicted), ROI_MARGIN, frame);
+    }
+    if (rois.size() != tracks.size()) {
+        // a tag is predicted to have left the frame
+        return false;
+    }
+    mergeRois(rois);
+    findTagsInRois(src, ROI_MARGIN);
+
+    // every tracked tag has to be found again, otherwise fall back to a full scan
+    for (const TrackedTag &track : tracks) {
+        if (find(ids.begin(), ids.end(), track.id) == ids.end()) {
+            return false;
+        }
+    }
+    return true;
 }
 
+void TagDetector::findTagsCoarseToFine(const Mat &src) {
+    ids.clear();
+    corners.clear();
+
+    // shrink before converting so the full frame is never converted
+    resize(src, coarseRgba, Size(), PYRAMID_SCALE, PYRAMID_SCALE, INTER_AREA);
+    cvtColor(coarseRgba, coarseRgb, COLOR_RGBA2RGB);
+
+    // rejected quads are kept too, far away tags are often found but can't be decoded at this scale
+    candidates.clear();
+    rejected.clear();
+    roiIds.clear();
+    cv::aruco::detectMarkers(coarseRgb, alvarDict, candidates, roiIds, alvarParams, rejected);
+    candidates.insert(candidates.end(), rejected.begin(), rejected.end());
+
+    const Rect frame(0, 0, src.cols, src.rows);
+    rois.clear();
+    for (vector<Point2f> &candidate : candidates) {
+        for (Point2f &corner : candidate) {
+            corner = Point2f(corner.x / PYRAMID_SCALE, corner.y / PYRAMID_SCALE);
+        }
+        addRoi(rois, boundingRect(candidate), PYRAMID_MARGIN, frame);
+    }
+    mergeRois(rois);
+    findTagsInRois(src, PYRAMID_MARGIN);
+}
+
+void TagDetector::setCoarseSearch(bool enabled) {
+    coarseSearch = enabled;
+}
+
+void TagDetector::updateTracks() {
+    vector<TrackedTag> updated;
+    updated.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        TrackedTag track{ids[i], corners[i], Point2f()};
+
+        // a tag seen last frame keeps moving the way it just did
+        for (const TrackedTag &previous : tracks) {
+            if (previous.id == ids[i]) {
+                track.velocity = getAverageTagCoordinateFromCorners(corners[i]) -
+                                 getAverageTagCoordinateFromCorners(previous.corners);
+                break;
+            }
+        }
+        updated.push_back(track);
+    }
+    tracks.swap(updated);
+}
+
+rover_msgs::Target TagDetector::measureTag(const Tag &tag, const Mat &depth_img) {
+    // tag corners are in undistorted pixels, so is the depth they're looked up in
+    const Mat &depth = cameraModel.isDistorted() ? undistortedDepth : depth_img;
+    rover_msgs::Target target;
+
+    // range over the whole tag, without enough depth fall back to the depth of the tag's pose
+    TagRangeEstimator::Range range = rangeEstimator.estimate(depth, tag.corners);
+    if (range.confidence >= RANGE_MIN_CONFIDENCE) {
+        target.distance = range.distance / MM_PER_M;
+    } else {
+        target.distance = tag.tvec[2];
+    }
+    target.bearing = cameraModel.bearing(tag.loc.x);
+    target.id = tag.id;
+    for (int axis = 0; axis < 3; ++axis) {
+        target.position[axis] = tag.tvec[axis];
+        target.rotation[axis] = tag.rvec[axis];
+    }
+    return target;
+}
+
+void TagDetector::updateDetectedTagInfo(rover_msgs::TargetList &arTags, vector<Tag> &tags, Mat &depth_img, Mat &src, int64_t timestamp){
+    detections.resize(tags.size());
+    for (size_t i = 0; i < tags.size(); ++i) {
+        detections[i] = measureTag(tags[i], depth_img);
+    }
+
+    // tags hidden for fewer than BUFFER_ITERATIONS frames are still sent where they're predicted to be
+    tagTracker.update(detections, timestamp);
+    tagTracker.fill(arTags);
+}
@@ -3,6 +3,10 @@
 #include <vector>
 #include "perception.hpp"
 #include "rover_msgs/Target.hpp"
+#include "rover_msgs/TargetList.hpp"
+#include "tag_range.hpp"
+#include "tag_tracker.hpp"
+#include "camera_model.hpp"
 
 using namespace std;
 using namespace cv;
@@ -10,6 +14,9 @@ using namespace cv;
 struct Tag {
     Point2f loc;
     int id;
+    vector<Point2f> corners;
+    Vec3d rvec; //orientation in the camera frame as a Rodrigues vector
+    Vec3d tvec; //center in the camera frame, meters
 };
 
 class TagDetector {
@@ -19,6 +26,54 @@ class TagDetector {
     std::vector<int> ids;
     std::vector<std::vector<cv::Point2f> > corners;
     cv::Mat rgb;
+
+    //A tag found last frame, velocity is how far its center moved since the frame before
+    struct TrackedTag {
+        int id;
+        std::vector<cv::Point2f> corners;
+        cv::Point2f velocity;
+    };
+    std::vector<TrackedTag> tracks;
+    int framesSinceFullScan = 0;
+
+    //Reused buffers for the regions searched while tracking
+    std::vector<cv::Rect> rois;
+    cv::Mat roiRgb;
+    cv::Mat roiScaled;
+    std::vector<int> roiIds;
+    std::vector<std::vector<cv::Point2f> > roiCorners;
+
+    //Reused buffers for the downscaled frame searched in coarse to fine mode
+    bool coarseSearch = false;
+    cv::Mat coarseRgba;
+    cv::Mat coarseRgb;
+    std::vector<std::vector<cv::Point2f> > candidates;
+    std::vector<std::vector<cv::Point2f> > rejected;
+
+    //Decodes tags in every region in rois at full resolution, appends them to ids and corners
+    //margin is the padding that was added around the expected tag, used to judge its size
+    void findTagsInRois(const Mat &src, double margin);
+
+    //Searches around where every tracked tag should be this frame, fills ids and corners
+    //Returns false if a tracked tag wasn't found, meaning a full scan is needed
+    bool findTrackedTags(const Mat &src);
+
+    //Finds candidate quads on a downscaled frame and only decodes those regions at full resolution
+    void findTagsCoarseToFine(const Mat &src);
+
+    //Replaces the tracks with the tags in ids and corners
+    void updateTracks();
+
+    //Pose estimation results
+    std::vector<cv::Vec3d> rvecs;
+    std::vector<cv::Vec3d> tvecs;
+
+    //Frames remapped to remove distortion, only used when the camera model has any
+    cv::Mat undistortedSrc;
+    cv::Mat undistortedDepth;
+
+    //This frame's tags before they go through the tracker
+    std::vector<rover_msgs::Target> detections;
     
    public:
    //Constants:
@@ -29,15 +84,43 @@ class TagDetector {
    int MM_PER_M;
    int DEFAULT_TAG_VAL;
 
+   //Region of interest tracking constants
+   bool ROI_TRACKING;
+   int ROI_FULL_SCAN_INTERVAL;
+   double ROI_MARGIN;
+   double ROI_UPSCALE;
+   int ROI_UPSCALE_BELOW;
+
+   //Coarse to fine search constants
+   bool PYRAMID_SEARCH;
+   double PYRAMID_SCALE;
+   double PYRAMID_MARGIN;
+
+   //Tags with a less confident range take their distance from the depth of their pose
+   double RANGE_MIN_CONFIDENCE;
+
+   //Side of a tag in meters, for pose estimation
+   double MARKER_LENGTH;
+
     //constructor loads alvar dictionary data from file that defines tag bit configurations
     TagDetector(const rapidjson::Document &mRoverConfig);    
     //takes detected AR tag and finds center coordinate for use with ZED                                                                 
     Point2f getAverageTagCoordinateFromCorners(const vector<Point2f> &corners);
-    //detects AR tags in a given Mat     
-    pair<Tag, Tag> findARTags(Mat &src, Mat &depth_src, Mat &rgb);    
-    //finds the angle from center given pixel coordinates              
-    double getAngle(float xPixel, float wPixel);     
-    //if AR tag found, updates distance, bearing, and id                              
-    void updateDetectedTagInfo(rover_msgs::Target *arTags, pair<Tag, Tag> &tagPair, Mat &depth_img, Mat &src); 
-    
+    //detects AR tags in a given Mat, returns all of them from left to right
+    vector<Tag> findARTags(Mat &src, Mat &depth_src, Mat &rgb);    
+    //full scans look for tags on a downscaled frame first while enabled, for when the rover is spinning
+    void setCoarseSearch(bool enabled);
+    //replaces the configured intrinsics, with the camera's own calibration when there is one
+    void setIntrinsics(const CameraIntrinsics &intrinsics);
+    //distance, bearing, id and pose of a tag from the last call to findARTags, before any filtering
+    rover_msgs::Target measureTag(const Tag &tag, const Mat &depth_img);
+    //fills the target list with the filtered distance, bearing, id and pose of every tracked tag,
+    //timestamp is when the frame was captured in microseconds since the epoch
+    void updateDetectedTagInfo(rover_msgs::TargetList &arTags, vector<Tag> &tags, Mat &depth_img, Mat &src, int64_t timestamp);
+
+   private:
+    //built from the constants above so they're declared after them
+    CameraModel cameraModel;
+    TagRangeEstimator rangeEstimator;
+    TagTracker tagTracker;
 };
@@ -0,0 +1,238 @@
+#include "perception.hpp"
+#include "rover_msgs/TargetList.hpp"
+#include "depth_obstacle_detector.hpp"
+#include "stage_timer.hpp"
+#include <dirent.h>
+#include <map>
+
+using namespace cv;
+using namespace std;
+
+/* --- Percep Bench --- */
+//Replays a recorded data folder through obstacle and AR tag detection as fast as possible
+//and reports how long every stage took, for both obstacle engines. The folder holds
+//rgb/*.jpg with matching depth/*.exr, and pcl/*.pcd
+//Usage: percep_bench <data folder> [passes] [fps]
+//Frames are stamped fps apart so the tag tracker sees the recording's frame interval, not how fast it replays
+
+namespace {
+    //Sorted names of the files in folder that end with one of tails
+    vector<string> listFiles(const string &folder, const vector<string> &tails) {
+        vector<string> names;
+        DIR *dir = opendir(folder.c_str());
+        if (!dir) {
+            return names;
+        }
+        while (struct dirent *dp = readdir(dir)) {
+            string name(dp->d_name);
+            for (const string &tail : tails) {
+                if (name.size() > tail.size() && name.compare(name.size() - tail.size(), tail.size(), tail) == 0) {
+                    names.push_back(name);
+                    break;
+                }
+            }
+        }
+        closedir(dir);
+        sort(names.begin(), names.end());
+        return names;
+    }
+
+    //Value below which fraction of the sorted samples fall
+    double percentile(const vector<double> &sorted, double fraction) {
+        size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+        return sorted[min(index, sorted.size() - 1)];
+    }
+
+    //Prints the percentiles of samples and a histogram with power of two millisecond buckets
+    void report(const string &name, vector<double> samples) {
+        if (samples.empty()) {
+            return;
+        }
+        sort(samples.begin(), samples.end());
+        double total = 0;
+        for (double sample : samples) {
+            total += sample;
+        }
+        printf("%-16s n=%-6zu mean=%8.3f p50=%8.3f p95=%8.3f p99=%8.3f max=%8.3f ms\n", name.c_str(), samples.size(),
+               total / samples.size(), percentile(samples, 0.5), percentile(samples, 0.95),
+               percentile(samples, 0.99), samples.back());
+
+        //Bucket i counts samples in [2^i, 2^(i+1)) ms, the lowest also takes everything faster
+        map<int, int> buckets;
+        for (double sample : samples) {
+            int bucket = sample < 1.0 / 64 ? -6 : static_cast<int>(floor(log2(sample)));
+            ++buckets[bucket];
+        }
+        for (const auto &bucket : buckets) {
+            int width = static_cast<int>(60.0 * bucket.second / samples.size() + 0.5);
+            printf("    < %9.3f ms %6d %s\n", pow(2.0, bucket.first + 1), bucket.second, string(width, '#').c_str());
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <data folder> [passes] [fps]\n";
+        return 1;
+    }
+    string folder = argv[1];
+    int passes = argc > 2 ? max(atoi(argv[2]), 1) : 1;
+    //Defaults to the rate the ZED captures at
+    double fps = argc > 3 ? atof(argv[3]) : 15;
+    if (fps <= 0) {
+        cerr << "fps must be positive\n";
+        return 1;
+    }
+
+    /* --- Reading in Config File --- */
+    rapidjson::Document mRoverConfig;
+    ifstream configFile;
+    string configPath = getenv("MROVER_CONFIG");
+    configPath += "/config_percep/config.json";
+    configFile.open( configPath );
+    string config = "";
+    string setting;
+    while( configFile >> setting ) {
+        config += setting;
+    }
+    configFile.close();
+    mRoverConfig.Parse( config.c_str() );
+
+    #if PERCEPTION_DEBUG
+        cerr << "Warning: built with perception_debug, ar tag timings include its debug output\n";
+    #endif
+
+    /* --- Preload Frames --- */
+    //Everything is read before timing starts so disk access doesn't show up in the numbers
+    #if AR_DETECTION || OBSTACLE_DETECTION
+    vector<Mat> images, depths;
+    for (const string &name : listFiles(folder + "/rgb", {".jpg", ".png"})) {
+        Mat bgr = imread(folder + "/rgb/" + name, IMREAD_COLOR);
+        Mat depth = imread(folder + "/depth/" + name.substr(0, name.size() - 4) + ".exr", IMREAD_ANYCOLOR | IMREAD_ANYDEPTH);
+        if (!bgr.data || !depth.data) {
+            cerr << "Skipping " << name << ", couldn't load the image or its depth\n";
+            continue;
+        }
+        //The detector takes frames laid out the way the ZED hands them over
+        Mat image;
+        cvtColor(bgr, image, COLOR_BGR2BGRA);
+        images.push_back(image);
+        depths.push_back(depth);
+    }
+    cout << "Loaded " << images.size() << " rgb/depth frames\n";
+    #endif
+
+    #if OBSTACLE_DETECTION
+    vector<pcl::PointCloud<pcl::PointXYZRGB>> clouds;
+    for (const string &name : listFiles(folder + "/pcl", {".pcd"})) {
+        clouds.emplace_back();
+        if (pcl::io::loadPCDFile<pcl::PointXYZRGB>(folder + "/pcl/" + name, clouds.back()) == -1) {
+            cerr << "Skipping " << name << ", couldn't load the cloud\n";
+            clouds.pop_back();
+        }
+    }
+    cout << "Loaded " << clouds.size() << " point clouds\n";
+    #endif
+
+    /* --- Obstacle Detection --- */
+    #if OBSTACLE_DETECTION
+    vector<double> stageSamples[NUM_OBSTACLE_STAGES];
+    vector<double> obstacleSamples;
+    {
+        PCL<NullSink> pointcloud(mRoverConfig);
+        cout << "frame,left_bearing,right_bearing,distance\n";
+        for (int pass = 0; pass < passes; ++pass) {
+            for (size_t i = 0; i < clouds.size(); ++i) {
+                //The copy isn't timed, detection filters the cloud in place
+                *pointcloud.pt_cloud_ptr = clouds[i];
+
+                double elapsed;
+                {
+                    StageTimer timer(elapsed);
+                    pointcloud.pcl_obstacle_detection();
+                }
+                obstacleSamples.push_back(elapsed);
+                for (int stage = 0; stage < NUM_OBSTACLE_STAGES; ++stage) {
+                    stageSamples[stage].push_back(pointcloud.stageTimes[stage]);
+                }
+
+                //Bearings are only printed for the first pass
+                if (pass == 0) {
+                    cout << i << "," << pointcloud.leftBearing << "," << pointcloud.rightBearing << ","
+                         << pointcloud.distance << "\n";
+                }
+            }
+        }
+    }
+
+    //The depth image engine runs on the same frames' depth for comparison
+    vector<double> depthObstacleSamples;
+    {
+        DepthObstacleDetector depthDetector(mRoverConfig);
+        cout << "frame,depth_left_bearing,depth_right_bearing,depth_distance\n";
+        for (int pass = 0; pass < passes; ++pass) {
+            for (size_t i = 0; i < depths.size(); ++i) {
+                double elapsed;
+                {
+                    StageTimer timer(elapsed);
+                    depthDetector.detect(depths[i]);
+                }
+                depthObstacleSamples.push_back(elapsed);
+
+                if (pass == 0) {
+                    cout << i << "," << depthDetector.leftBearing << "," << depthDetector.rightBearing << ","
+                         << depthDetector.distance << "\n";
+                }
+            }
+        }
+    }
+    #endif
+
+    /* --- AR Tag Detection --- */
+    #if AR_DETECTION
+    vector<double> arSamples;
+    const int64_t FRAME_PERIOD = static_cast<int64_t>(1e6 / fps);
+    {
+        rover_msgs::TargetList arTags;
+        arTags.num_targets = 0;
+        Mat rgb;
+        //Every tag found in a frame gets its own row
+        cout << "frame,tag_id,tag_bearing,tag_distance,tag_x,tag_y,tag_z\n";
+        for (int pass = 0; pass < passes; ++pass) {
+            //Every pass starts cold, without the tracks and filtered tags the last one left behind
+            TagDetector detector(mRoverConfig);
+            for (size_t i = 0; i < images.size(); ++i) {
+                double elapsed;
+                {
+                    StageTimer timer(elapsed);
+                    vector<Tag> tags = detector.findARTags(images[i], depths[i], rgb);
+                    detector.updateDetectedTagInfo(arTags, tags, depths[i], images[i], i * FRAME_PERIOD);
+                }
+                arSamples.push_back(elapsed);
+
+                if (pass == 0) {
+                    for (const rover_msgs::Target &target : arTags.targetList) {
+                        cout << i << "," << target.id << "," << target.bearing << "," << target.distance << ","
+                             << target.position[0] << "," << target.position[1] << "," << target.position[2] << "\n";
+                    }
+                }
+            }
+        }
+    }
+    #endif
+
+    /* --- Latency Report --- */
+    cout << "\nLatency over " << passes << " pass(es)\n";
+    #if OBSTACLE_DETECTION
+    for (int stage = 0; stage < NUM_OBSTACLE_STAGES; ++stage) {
+        report(OBSTACLE_STAGE_NAMES[stage], stageSamples[stage]);
+    }
+    report("obstacle_total", obstacleSamples);
+    report("depth_obstacle", depthObstacleSamples);
+    #endif
+    #if AR_DETECTION
+    report("ar_tags", arSamples);
+    #endif
+
+    return 0;
+}
@@ -1,5 +1,8 @@
 #include "camera.hpp"
 #include "perception.hpp"
+#include "recording.hpp"
+#include "ar_recorder.hpp"
+#include "camera_model.hpp"
 
 #if OBSTACLE_DETECTION
     #include <pcl/common/common_headers.h>
@@ -11,6 +14,9 @@
 
 #include <sl/Camera.hpp>
 #include <cassert>
+#if defined(__AVX__)
+    #include <immintrin.h>
+#endif
 
 #pragma GCC diagnostic pop
 //Class created to implement all Camera class' functions
@@ -26,6 +32,9 @@ public:
 
 	cv::Mat image();
 	cv::Mat depth();
+	bool intrinsics(CameraIntrinsics &intrinsics);
+	unsigned droppedFrames();
+	int64_t timestamp();
     
     //constants
     int THRESHOLD_CONFIDENCE;
@@ -44,6 +53,12 @@ private:
 
 	cv::Mat image_;
 	cv::Mat depth_;
+
+    #if OBSTACLE_DETECTION
+    //Persistent XYZRGBA buffer, retrieveMeasure reuses it as long as the resolution matches
+    sl::Resolution cloud_res_;
+    sl::Mat data_cloud_;
+    #endif
 };
 
 Camera::Impl::Impl(const rapidjson::Document &config) : THRESHOLD_CONFIDENCE(config["camera"]["threshold_confidence"].GetDouble()) {
@@ -79,12 +94,27 @@ Camera::Impl::Impl(const rapidjson::Document &config) : THRESHOLD_CONFIDENCE(con
 	this->depth_ = cv::Mat(
 		this->image_size_.height, this->image_size_.width, CV_32FC1,
 		this->depth_zed_.getPtr<sl::uchar1>(sl::MEM::CPU));
+
+    #if OBSTACLE_DETECTION
+    this->cloud_res_ = sl::Resolution(config["pt_cloud"]["pt_cloud_width"].GetInt(),
+                                      config["pt_cloud"]["pt_cloud_height"].GetInt());
+    this->data_cloud_.alloc(this->cloud_res_, sl::MAT_TYPE::F32_C4, sl::MEM::CPU);
+    #endif
 }
 
 bool Camera::Impl::grab() {
     return this->zed_.grab() == sl::ERROR_CODE::SUCCESS;
 }
 
+unsigned Camera::Impl::droppedFrames() {
+    return this->zed_.getFrameDroppedCount();
+}
+
+//The SDK stamps every image when it is captured, before grab returns it
+int64_t Camera::Impl::timestamp() {
+    return static_cast<int64_t>(this->zed_.getTimestamp(sl::TIME_REFERENCE::IMAGE).getMicroseconds());
+}
+
 cv::Mat Camera::Impl::image() {
 	this->zed_.retrieveImage(this->image_zed_, sl::VIEW::LEFT, sl::MEM::CPU,
 							 this->image_size_);
@@ -96,6 +126,19 @@ cv::Mat Camera::Impl::depth() {
 	return this->depth_;
 }
 
+bool Camera::Impl::intrinsics(CameraIntrinsics &intrinsics) {
+    //The ZED hands out rectified images, so its lens distortion has already been removed
+    sl::CameraParameters left = this->zed_.getCameraInformation().calibration_parameters.left_cam;
+    intrinsics.width = static_cast<int>(this->image_size_.width);
+    intrinsics.height = static_cast<int>(this->image_size_.height);
+    intrinsics.fx = left.fx;
+    intrinsics.fy = left.fy;
+    intrinsics.cx = left.cx;
+    intrinsics.cy = left.cy;
+    intrinsics.distortion.clear();
+    return true;
+}
+
 //This function convert a RGBA color packed into a packed RGBA PCL compatible format
 inline float convertColor(float colorIn) {
     uint32_t color_uint = *(uint32_t *) & colorIn;
@@ -104,7 +147,77 @@ inline float convertColor(float colorIn) {
     return *reinterpret_cast<float *> (&color_uint);
 }
 
+#if OBSTACLE_DETECTION
+//Copies numPoints XYZRGBA floats from the ZED into dst, dropping invalid measures
+//and converting the colour with the same byte order as convertColor
+//Returns the number of points written, dst must have room for numPoints
+static size_t convertValidPoints(const float *src, size_t numPoints, pcl::PointXYZRGB *dst) {
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    //Works on 8 points at a time: transposes them so the X values and the colours
+    //each sit in one register, tests X for every point at once and shuffles all
+    //8 colours with one byte shuffle per half
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    const __m256 infinity = _mm256_set1_ps(INFINITY);
+    const __m128i colorShuffle = _mm_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+    const __m128 one = _mm_set1_ps(1.0f);
+    alignas(16) uint32_t colors[8];
+
+    for (; i + 8 <= numPoints; i += 8) {
+        const float *block = src + 4 * i;
+        __m128 p[8];
+        for (int j = 0; j < 8; ++j) {
+            p[j] = _mm_loadu_ps(block + 4 * j);
+        }
+
+        //Columns of each 4x4 transpose are X, Y, Z and RGBA
+        __m128 x0 = p[0], y0 = p[1], z0 = p[2], c0 = p[3];
+        __m128 x1 = p[4], y1 = p[5], z1 = p[6], c1 = p[7];
+        _MM_TRANSPOSE4_PS(x0, y0, z0, c0);
+        _MM_TRANSPOSE4_PS(x1, y1, z1, c1);
+
+        //isValidMeasure: X is neither NaN nor +-inf
+        __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+        int valid = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_and_ps(x, absMask), infinity, _CMP_LT_OQ));
+        if (!valid) {
+            continue;
+        }
+
+        _mm_store_si128(reinterpret_cast<__m128i *>(colors), _mm_shuffle_epi8(_mm_castps_si128(c0), colorShuffle));
+        _mm_store_si128(reinterpret_cast<__m128i *>(colors + 4), _mm_shuffle_epi8(_mm_castps_si128(c1), colorShuffle));
+
+        for (int j = 0; j < 8; ++j) {
+            if (valid & (1 << j)) {
+                pcl::PointXYZRGB &out = dst[count++];
+                _mm_storeu_ps(out.data, _mm_blend_ps(p[j], one, 0x8));
+                out.rgba = colors[j];
+            }
+        }
+    }
+#endif
+
+    //Scalar tail, or the whole cloud when AVX is not available
+    for (; i < numPoints; ++i) {
+        const float *point = src + 4 * i;
+        if (!isValidMeasure(point[0])) {
+            continue;
+        }
+        pcl::PointXYZRGB &out = dst[count++];
+        out.x = point[0];
+        out.y = point[1];
+        out.z = point[2];
+        out.rgb = convertColor(point[3]);
+    }
+    return count;
+}
+#endif
+
 Camera::Impl::~Impl() {
+    #if OBSTACLE_DETECTION
+    this->data_cloud_.free(sl::MEM::CPU);
+    #endif
     this->depth_zed_.free(sl::MEM::CPU);
     this->image_zed_.free(sl::MEM::CPU);
 	this->zed_.close();
@@ -112,28 +225,18 @@ Camera::Impl::~Impl() {
 
 #if OBSTACLE_DETECTION
 void Camera::Impl::dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & p_pcl_point_cloud) {
-    //Might need an overloaded assignment operator
-  
-    //Grab ZED Depth Image
-    sl::Resolution cloud_res(p_pcl_point_cloud->width, p_pcl_point_cloud->height);
-    sl::Mat data_cloud;
-    this->zed_.retrieveMeasure(data_cloud, sl::MEASURE::XYZRGBA, sl::MEM::CPU, cloud_res);
-  
-    //Populate Point Cloud
-    float *p_data_cloud = data_cloud.getPtr<float>();
-    int index = 0;
-    for (auto &it : p_pcl_point_cloud->points) {
-        float X = p_data_cloud[index];
-        if (!isValidMeasure(X)) // Checking if it's a valid point
-            it.x = it.y = it.z = it.rgb = 0;
-        else {
-            it.x = X;
-            it.y = p_data_cloud[index + 1];
-            it.z = p_data_cloud[index + 2];
-            it.rgb = convertColor(p_data_cloud[index + 3]); // Convert a 32bits float into a pcl .rgb format
-        }
-    index += 4;
-  }
+    //Grab ZED point cloud into the persistent buffer
+    this->zed_.retrieveMeasure(this->data_cloud_, sl::MEASURE::XYZRGBA, sl::MEM::CPU, this->cloud_res_);
+
+    //Populate Point Cloud, invalid points are dropped instead of being zeroed
+    //so the cloud is no longer organized after this
+    size_t numPoints = this->cloud_res_.area();
+    p_pcl_point_cloud->points.resize(numPoints);
+    size_t count = convertValidPoints(this->data_cloud_.getPtr<float>(), numPoints, p_pcl_point_cloud->points.data());
+    p_pcl_point_cloud->points.resize(count);
+    p_pcl_point_cloud->width = count;
+    p_pcl_point_cloud->height = 1;
+    p_pcl_point_cloud->is_dense = true;
 }
 #endif
 
@@ -157,14 +260,24 @@ public:
 
     #if OBSTACLE_DETECTION
     void dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud);
-    void pcl_write(const cv::String &filename, pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud);
-
     #endif
 
+    bool intrinsics(CameraIntrinsics &intrinsics);
+    unsigned droppedFrames();
+    int64_t timestamp();
+
     void disk_record_init();
     void write_curr_frame_to_disk(cv::Mat rgb, cv::Mat depth, int counter);
 
 private:
+    //Set when path is a recording instead of a folder
+    bool from_recording;
+    RecordingReader recording;
+    size_t idx_curr_frame;
+
+    //When the last frame was read, microseconds since the epoch
+    int64_t capture_time;
+
     std::vector<std::string> img_names;
     std::vector<std::string> pcd_names;
 
@@ -181,15 +294,31 @@ private:
 };
 
 Camera::Impl::~Impl() {
-    closedir(rgb_dir);
-    closedir(depth_dir);
-    closedir(pcd_dir);
+    if (rgb_dir) closedir(rgb_dir);
+    if (depth_dir) closedir(depth_dir);
+    if (pcd_dir) closedir(pcd_dir);
 }
 
-Camera::Impl::Impl(const rapidjson::Document &config) {
+Camera::Impl::Impl(const rapidjson::Document &config) :
+    from_recording{false}, idx_curr_frame{0}, capture_time{0}, rgb_dir{nullptr}, depth_dir{nullptr}, pcd_dir{nullptr} {
   
-    std::cout<<"Please input the folder path (there should be a rgb and depth existing in this folder): ";
+    std::cout<<"Please input the folder path (there should be a rgb and depth existing in this folder) or a .mrec recording: ";
     std::cin>>path;
+
+    //Recordings are memory mapped and indexed, every frame is read straight from the mapping
+    const std::string recording_tail = ".mrec";
+    if (path.size() > recording_tail.size() &&
+        path.compare(path.size() - recording_tail.size(), recording_tail.size(), recording_tail) == 0) {
+        from_recording = true;
+        if (!recording.open(path)) {
+            exit(1);
+        }
+        #if PERCEPTION_DEBUG
+            std::cout<<"Opened recording with "<<recording.size()<<" frames\n";
+        #endif
+        return;
+    }
+
     #if AR_DETECTION
     rgb_path = path + "/rgb";
     depth_path = path + "/depth";
@@ -275,10 +404,37 @@ do{
 #endif
 }
 
+//Recorded frames don't carry a calibration, the configured intrinsics are used for them
+bool Camera::Impl::intrinsics(CameraIntrinsics &) {
+    return false;
+}
+
+//Every frame of a recording or folder is read, none are ever dropped
+unsigned Camera::Impl::droppedFrames() {
+    return 0;
+}
+
+//Offline frames are stamped when they are read, as if the camera had just captured them
+int64_t Camera::Impl::timestamp() {
+    return capture_time;
+}
+
 bool Camera::Impl::grab() {
+    capture_time = microsecondsSinceEpoch();
 
     bool end = true;
 
+    //Frame numbers are positions in the recording, so moving to the next one is just an increment
+    if (from_recording) {
+        idx_curr_frame++;
+        if (idx_curr_frame >= recording.size()) {
+            //The pipeline takes false as the end of the stream and shuts down cleanly
+            std::cout<<"Ran out of images\n";
+            end = false;
+        }
+        return end;
+    }
+
     #if AR_DETECTION
     idx_curr_img++;
     if (idx_curr_img >= img_names.size()) {
@@ -302,6 +458,9 @@ bool Camera::Impl::grab() {
 
 #if AR_DETECTION
 cv::Mat Camera::Impl::image() {
+    if (from_recording) {
+        return recording.rgb(idx_curr_frame);
+    }
     std::string full_path = rgb_path + std::string("/") + (img_names[idx_curr_img]);
     #if PERCEPTION_DEBUG
         cout << img_names[idx_curr_img] << "\n";
@@ -315,6 +474,10 @@ cv::Mat Camera::Impl::image() {
 }
 
 cv::Mat Camera::Impl::depth() {
+    //View into the recording, valid until the next call
+    if (from_recording) {
+        return recording.depth(idx_curr_frame);
+    }
     std::string rgb_name = img_names[idx_curr_img];
     std::string full_path = depth_path + std::string("/") +
                             rgb_name.substr(0, rgb_name.size()-4) + std::string(".exr");
@@ -328,47 +491,18 @@ cv::Mat Camera::Impl::depth() {
     return img;
 }
 
-void Camera::record_ar_init() {
-  //initializing ar tag videostream object
-  std::pair<Tag, Tag> tp;
-  TagDetector d1(mRoverConfig);
-
-
-    Mat depth_img = depth();
-    Mat rgb;
-    Mat src = image();
-
-    tp = d1.findARTags(src, depth_img, rgb);
-    Size fsize = rgb.size();
-
-    time_t now = time(0);
-    char* ltm = ctime(&now);
-    string timeStamp(ltm);
-
-    string s = "artag_number_" + timeStamp + ".avi";
-
-    vidWrite =  VideoWriter(s, VideoWriter::fourcc('M','J','P','G'),10,fsize,true);
-
-    if(vidWrite.isOpened() == false)
-    {
-        cerr << "ar record didn't open\n";
-        exit(1);
-    }
-}
-
-void Camera::record_ar(Mat rgb) {
-    vidWrite.write(rgb);
-}
-
-void Camera::record_ar_finish() {
-    vidWrite.release();
-}
 #endif
 
 
 //Reads the point data cloud p_pcl_point_cloud
 #if OBSTACLE_DETECTION
 void Camera::Impl::dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud){
+ if (from_recording) {
+    if (!recording.cloud(idx_curr_frame, *p_pcl_point_cloud)) {
+        std::cerr<<"Frame "<<recording.frameId(idx_curr_frame)<<" has no point cloud\n";
+    }
+    return;
+ }
  
  //Read in image names
  std::string pcd_name = pcd_names[idx_curr_pcd_img];
@@ -383,10 +517,12 @@ void Camera::Impl::dataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point
 #endif
 
 Camera::Camera(const rapidjson::Document &config) : 
-    impl_{new Camera::Impl(config)}, rgb_foldername{""}, depth_foldername{""}, pcl_foldername{""} , mRoverConfig( config ),
+    impl_{new Camera::Impl(config)}, recorder_{nullptr}, arRecorder_{nullptr}, mRoverConfig( config ),
             FRAME_WRITE_INTERVAL{mRoverConfig["camera"]["frame_write_interval"].GetInt()} {}
 
 Camera::~Camera() {
+	delete this->arRecorder_;
+	delete this->recorder_;
 	delete this->impl_;
 }
 
@@ -394,6 +530,18 @@ bool Camera::grab() {
 	return this->impl_->grab();
 }
 
+bool Camera::intrinsics(CameraIntrinsics &intrinsics) {
+	return this->impl_->intrinsics(intrinsics);
+}
+
+unsigned Camera::droppedFrames() {
+	return this->impl_->droppedFrames();
+}
+
+int64_t Camera::timestamp() {
+	return this->impl_->timestamp();
+}
+
 #if AR_DETECTION
 cv::Mat Camera::image() {
 	return this->impl_->image();
@@ -410,47 +558,75 @@ void Camera::getDataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cl
 }
 #endif
 
+#if AR_DETECTION
+//Starts the video of annotated ar tag frames, the encoder opens it once the first frame comes in
+void Camera::record_ar_init() {
+    time_t now = time(0);
+    char timeStamp[32];
+    strftime(timeStamp, sizeof(timeStamp), "%Y%m%d_%H%M%S", localtime(&now));
+    string s = "artag_number_" + string(timeStamp) + ".avi";
+
+    const rapidjson::Value &settings = mRoverConfig["ar_record"];
+    string fourcc = settings["fourcc"].GetString();
+    ArRecorder::DropPolicy policy = string(settings["drop_policy"].GetString()) == "keep_latest" ?
+                                    ArRecorder::KEEP_LATEST : ArRecorder::DROP_NEWEST;
+    arRecorder_ = new ArRecorder(s, VideoWriter::fourcc(fourcc[0], fourcc[1], fourcc[2], fourcc[3]),
+                                 settings["fps"].GetDouble(), settings["ring_size"].GetInt(), policy);
+}
+
+//Hands the frame to the encoder thread, never waits on it
+void Camera::record_ar(Mat rgb) {
+    arRecorder_->record(rgb);
+}
+
+void Camera::record_ar_finish() {
+    arRecorder_->finish();
+}
+#endif
+
 #if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
 
-// creates and opens folder to write to
+// creates the data folder and starts a recording in it
 void Camera::disk_record_init() {
-    //defining directories to write to
-    rgb_foldername = DEFAULT_ONLINE_DATA_FOLDER "rgb/";
-    depth_foldername = DEFAULT_ONLINE_DATA_FOLDER "depth/";
-    string mkdir_rgb =  std::string("mkdir -p ") + rgb_foldername;
-    string mkdir_depth =  std::string("mkdir -p ") + depth_foldername;
-    pcl_foldername = DEFAULT_ONLINE_DATA_FOLDER "pcl/";
-    string mkdir_pcl = std::string("mkdir -p ") + pcl_foldername;
+    string mkdir_data = std::string("mkdir -p ") + DEFAULT_ONLINE_DATA_FOLDER;
 
     //creates new folder in the system
-    if (-1 == system(mkdir_pcl.c_str()) || -1 == system( mkdir_rgb.c_str()) || -1 == system(mkdir_depth.c_str())) 
+    if (-1 == system(mkdir_data.c_str()))
     {
         exit(1);
     }
-}
 
-//writes the Mat to a file
+    time_t now = time(0);
+    char timeStamp[32];
+    strftime(timeStamp, sizeof(timeStamp), "%Y%m%d_%H%M%S", localtime(&now));
+    string path = DEFAULT_ONLINE_DATA_FOLDER + std::string("recording_") + timeStamp + ".mrec";
 
-//Writes point cloud data to data folder specified in build tag 
-void pcl_write(const cv::String &filename, pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud){
-    #if PERCEPTION_DEBUG
-        std::cout << "name of path is: " << filename << endl;
-    #endif
-    try{ pcl::io::savePCDFileASCII (filename, *p_pcl_point_cloud); }
-    catch (pcl::IOException &e){
-        cout << e.what();
+    recorder_ = new RecordingWriter(path, mRoverConfig["camera"]["recording_queue_depth"].GetInt(),
+                                    mRoverConfig["camera"]["recording_compression_level"].GetInt());
+    if (!recorder_->isOpen()) {
+        exit(1);
     }
 }
 
+//Queues the frame for the recording, it is compressed and written on the recorder's thread
+//rgb and depth must not be written to afterwards, the recorder keeps referencing them
 void Camera::write_curr_frame_to_disk(cv::Mat rgb, cv::Mat depth, pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud, int counter){
-    string fileName = to_string(counter / FRAME_WRITE_INTERVAL);
-    while(fileName.length() < 4){
-        fileName = '0'+fileName;
+    std::unique_ptr<RecordingFrame> frame(new RecordingFrame);
+    frame->id = counter;
+    frame->rgb = rgb;
+    frame->depth = depth;
+    frame->cloud = *p_pcl_point_cloud;
+
+    if (!recorder_->write(std::move(frame))) {
+        #if PERCEPTION_DEBUG
+            std::cout << "Recording queue full, dropped frame " << counter << endl;
+        #endif
     }
+}
 
-    pcl_write(pcl_foldername + fileName + std::string(".pcd"), p_pcl_point_cloud);
-    cv::imwrite(rgb_foldername +  fileName + std::string(".jpg"), rgb );
-    cv::imwrite(depth_foldername +  fileName + std::string(".exr"), depth );
+//Writes out every queued frame and the recording's index
+void Camera::disk_record_finish() {
+    recorder_->close();
 }
 
 #endif
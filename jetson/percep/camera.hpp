@@ -6,14 +6,16 @@
 	#include <pcl/common/common_headers.h>
 #endif
 
+class RecordingWriter;
+class ArRecorder;
+struct CameraIntrinsics;
+
 class Camera {
 private:
 	class Impl;
 	Impl *impl_;
-	std::string rgb_foldername;
-	std::string depth_foldername;
-	std::string pcl_foldername;
-	cv::VideoWriter vidWrite;
+	RecordingWriter *recorder_;
+	ArRecorder *arRecorder_;
 
     //reference to config file
     const rapidjson::Document& mRoverConfig;
@@ -29,6 +31,15 @@ public:
 
 	cv::Mat image();
 	cv::Mat depth();
+
+	//fills in the left camera's calibration, returns false if the source doesn't have one
+	bool intrinsics(CameraIntrinsics &intrinsics);
+
+	//frames the camera has dropped since it opened, always 0 for recorded sources
+	unsigned droppedFrames();
+
+	//capture time of the last grabbed frame, microseconds since the epoch
+	int64_t timestamp();
 	
 	#if OBSTACLE_DETECTION
 	void getDataCloud(pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud);
@@ -37,6 +48,7 @@ public:
 	#if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
 	void disk_record_init();
 	void write_curr_frame_to_disk(cv::Mat rgb, cv::Mat depth, pcl::PointCloud<pcl::PointXYZRGB>::Ptr &p_pcl_point_cloud, int counter);
+	void disk_record_finish();
 	#endif
 
 	void record_ar_init();
@@ -0,0 +1,117 @@
+#include "camera_model.hpp"
+#include "perception.hpp"
+
+CameraModel::CameraModel(const rapidjson::Document &config) : distorted{false} {
+    const rapidjson::Value &json = config["ar_tag"]["intrinsics"];
+    CameraIntrinsics configured;
+    configured.width = json["width"].GetInt();
+    configured.height = json["height"].GetInt();
+    configured.fx = json["fx"].GetDouble();
+    configured.fy = json["fy"].GetDouble();
+    configured.cx = json["cx"].GetDouble();
+    configured.cy = json["cy"].GetDouble();
+    const rapidjson::Value &distortion = json["distortion"];
+    for (rapidjson::SizeType i = 0; i < distortion.Size(); ++i) {
+        configured.distortion.push_back(distortion[i].GetDouble());
+    }
+
+    //A calibration file in the layout OpenCV's calibration sample writes takes precedence
+    std::string calibrationFile = json["calibration_file"].GetString();
+    if (!calibrationFile.empty()) {
+        cv::FileStorage fs(calibrationFile, cv::FileStorage::READ);
+        if (!fs.isOpened()) {
+            std::cerr << "Couldn't open camera calibration " << calibrationFile << ", using the configured intrinsics\n";
+        } else {
+            cv::Mat matrix, coefficients;
+            fs["camera_matrix"] >> matrix;
+            fs["distortion_coefficients"] >> coefficients;
+            fs["image_width"] >> configured.width;
+            fs["image_height"] >> configured.height;
+            matrix.convertTo(matrix, CV_64F);
+            coefficients.convertTo(coefficients, CV_64F);
+            configured.fx = matrix.at<double>(0, 0);
+            configured.fy = matrix.at<double>(1, 1);
+            configured.cx = matrix.at<double>(0, 2);
+            configured.cy = matrix.at<double>(1, 2);
+            configured.distortion.assign(coefficients.ptr<double>(), coefficients.ptr<double>() + coefficients.total());
+        }
+        fs.release();
+    }
+    setIntrinsics(configured);
+}
+
+void CameraModel::setIntrinsics(const CameraIntrinsics &newIntrinsics) {
+    intrinsics = newIntrinsics;
+    distorted = false;
+    for (double coefficient : intrinsics.distortion) {
+        distorted = distorted || coefficient != 0;
+    }
+    if (frameSize.area() > 0) {
+        build();
+    }
+}
+
+void CameraModel::setFrameSize(cv::Size size) {
+    if (size != frameSize) {
+        frameSize = size;
+        build();
+    }
+}
+
+void CameraModel::build() {
+    double sx = static_cast<double>(frameSize.width) / intrinsics.width;
+    double sy = static_cast<double>(frameSize.height) / intrinsics.height;
+    double fx = intrinsics.fx * sx, fy = intrinsics.fy * sy;
+    double cx = intrinsics.cx * sx, cy = intrinsics.cy * sy;
+    K = cv::Mat::zeros(3, 3, CV_64F);
+    K.at<double>(0, 0) = fx;
+    K.at<double>(0, 2) = cx;
+    K.at<double>(1, 1) = fy;
+    K.at<double>(1, 2) = cy;
+    K.at<double>(2, 2) = 1;
+    D = cv::Mat::zeros(1, static_cast<int>(intrinsics.distortion.size()), CV_64F);
+    for (size_t i = 0; i < intrinsics.distortion.size(); ++i) {
+        D.at<double>(0, static_cast<int>(i)) = intrinsics.distortion[i];
+    }
+
+    //Undistorted frames keep the same camera matrix, so the bearing of a column is just its pinhole angle
+    columnBearings.resize(frameSize.width);
+    for (int x = 0; x < frameSize.width; ++x) {
+        columnBearings[x] = static_cast<float>(std::atan((x - cx) / fx) * 180.0 / PI);
+    }
+
+    if (distorted) {
+        cv::initUndistortRectifyMap(K, D, cv::Mat(), K, frameSize, CV_16SC2, mapX, mapY);
+    } else {
+        mapX.release();
+        mapY.release();
+    }
+}
+
+double CameraModel::bearing(float x) const {
+    if (columnBearings.empty()) {
+        return 0;
+    }
+    //Interpolate between the columns on either side, clamped to the frame
+    float clamped = std::min(std::max(x, 0.0f), static_cast<float>(columnBearings.size() - 1));
+    size_t left = static_cast<size_t>(clamped);
+    size_t right = std::min(left + 1, columnBearings.size() - 1);
+    float t = clamped - left;
+    return columnBearings[left] + (columnBearings[right] - columnBearings[left]) * t;
+}
+
+bool CameraModel::isDistorted() const {
+    return distorted;
+}
+
+void CameraModel::undistort(const cv::Mat &src, cv::Mat &dst, int interpolation) const {
+    if (!distorted) {
+        dst = src;
+        return;
+    }
+    cv::remap(src, dst, mapX, mapY, interpolation);
+}
+
+const cv::Mat &CameraModel::cameraMatrix() const {
+    return K;
+}
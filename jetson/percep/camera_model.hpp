@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "rapidjson/document.h"
+
+//Pinhole intrinsics for an image of width by height, distortion is in OpenCV's order
+struct CameraIntrinsics {
+    int width;
+    int height;
+    double fx, fy, cx, cy;
+    std::vector<double> distortion;
+};
+
+/* --- Camera Model --- */
+/**
+\brief Calibrated pinhole model of the left camera
+Intrinsics come from the ZED's factory calibration when there is a ZED, else
+from an OpenCV calibration file or the config. They are scaled to whatever
+frame size is in use. Bearings come from a table with one entry per column,
+computed along the principal row, and images can be undistorted through
+precomputed remap tables. The ZED's images are already rectified, so there
+the distortion is zero and undistortion is skipped
+*/
+class CameraModel {
+public:
+    //Reads ar_tag.intrinsics, which can name an OpenCV calibration file to use instead
+    CameraModel(const rapidjson::Document &config);
+
+    void setIntrinsics(const CameraIntrinsics &intrinsics);
+
+    //Rebuilds the tables if size differs from the frame size they were built for
+    void setFrameSize(cv::Size size);
+
+    //Degrees from straight ahead of a pixel column, positive to the right, x can be fractional
+    double bearing(float x) const;
+
+    //Whether images have to be undistorted before the model's camera matrix applies to them
+    bool isDistorted() const;
+
+    //Remaps src into dst so it has no distortion, linear for images and nearest for measures like depth
+    void undistort(const cv::Mat &src, cv::Mat &dst, int interpolation = cv::INTER_LINEAR) const;
+
+    //Camera matrix for the current frame size, of undistorted frames
+    const cv::Mat &cameraMatrix() const;
+
+private:
+    void build();
+
+    CameraIntrinsics intrinsics;
+    bool distorted;
+    cv::Size frameSize;
+
+    cv::Mat K;
+    cv::Mat D;
+    std::vector<float> columnBearings;
+    cv::Mat mapX, mapY;
+};
@@ -0,0 +1,76 @@
+#include "perception.hpp"
+#include "recording.hpp"
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace cv;
+using namespace std;
+
+/* --- Percep Convert --- */
+//Packs a folder of frames written one file at a time (rgb/*.jpg, depth/*.exr, pcl/*.pcd)
+//into a single recording so it can be memory mapped instead of parsed on every replay
+//Usage: percep_convert <data folder> <output .mrec> [compression level]
+//A compression level of 0 stores depth and clouds raw, which lets readers use them in place
+
+namespace {
+    //Sorted names of the files in folder ending with tail, without the tail
+    vector<string> listStems(const string &folder, const string &tail) {
+        vector<string> stems;
+        DIR *dir = opendir(folder.c_str());
+        if (!dir) {
+            return stems;
+        }
+        while (struct dirent *dp = readdir(dir)) {
+            string name(dp->d_name);
+            if (name.size() > tail.size() && name.compare(name.size() - tail.size(), tail.size(), tail) == 0) {
+                stems.push_back(name.substr(0, name.size() - tail.size()));
+            }
+        }
+        closedir(dir);
+        sort(stems.begin(), stems.end());
+        return stems;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <data folder> <output .mrec> [compression level]\n";
+        return 1;
+    }
+    string folder = argv[1];
+    int compressionLevel = argc > 3 ? atoi(argv[3]) : 1;
+
+    //Frames are matched by file name, the pcd names drive the order when there are any
+    vector<string> stems = listStems(folder + "/pcl", ".pcd");
+    if (stems.empty()) {
+        stems = listStems(folder + "/rgb", ".jpg");
+    }
+
+    RecordingWriter writer(argv[2], 8, compressionLevel);
+    if (!writer.isOpen()) {
+        return 1;
+    }
+
+    for (size_t i = 0; i < stems.size(); ++i) {
+        std::unique_ptr<RecordingFrame> frame(new RecordingFrame);
+        frame->id = static_cast<int>(i);
+        frame->rgb = imread(folder + "/rgb/" + stems[i] + ".jpg", IMREAD_COLOR);
+        frame->depth = imread(folder + "/depth/" + stems[i] + ".exr", IMREAD_ANYCOLOR | IMREAD_ANYDEPTH);
+
+        #if OBSTACLE_DETECTION
+        string pcdPath = folder + "/pcl/" + stems[i] + ".pcd";
+        if (access(pcdPath.c_str(), R_OK) == 0 && pcl::io::loadPCDFile<pcl::PointXYZRGB>(pcdPath, frame->cloud) == -1) {
+            cerr << "Couldn't read " << pcdPath << "\n";
+        }
+        #endif
+
+        writer.write(std::move(frame), true);
+        if ((i + 1) % 100 == 0) {
+            cout << "Converted " << i + 1 << " of " << stems.size() << " frames\n";
+        }
+    }
+
+    writer.close();
+    cout << "Wrote " << stems.size() << " frames to " << argv[2] << "\n";
+    return 0;
+}
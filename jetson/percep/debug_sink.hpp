@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <pcl/common/time.h>
+#include <pcl/point_types.h>
+
+/* --- Debug Sinks --- */
+//Policies for where PCL's debug output goes, picked as its template parameter
+//so one binary carries both an instrumented and an uninstrumented pipeline.
+//Debug-only work is written as if (Sink::ENABLED) so it compiles away for NullSink
+
+//Drops everything, every stage runs as if there were no debugging at all
+struct NullSink {
+    static constexpr bool ENABLED = false;
+
+    //Stands in for pcl::ScopeTime
+    struct Scope {
+        explicit Scope(const char *) {}
+    };
+
+    static void color(pcl::PointXYZRGB &, uint8_t, uint8_t, uint8_t) {}
+};
+
+//Times every stage, prints what it finds and colors points for the viewers
+struct DebugSink {
+    static constexpr bool ENABLED = true;
+
+    //Prints how long the enclosing scope took when it ends
+    typedef pcl::ScopeTime Scope;
+
+    static void color(pcl::PointXYZRGB &point, uint8_t r, uint8_t g, uint8_t b) {
+        point.r = r;
+        point.g = g;
+        point.b = b;
+    }
+};
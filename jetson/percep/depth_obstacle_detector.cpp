@@ -0,0 +1,129 @@
+#include "depth_obstacle_detector.hpp"
+#include "perception.hpp"
+#include <cmath>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+DepthObstacleDetector::DepthObstacleDetector(const rapidjson::Document &config) :
+    WIDTH{config["depth_obstacle"]["width"].GetInt()},
+    HEIGHT{config["depth_obstacle"]["height"].GetInt()},
+    MAX_FIELD_OF_VIEW_ANGLE{static_cast<double>(config["pt_cloud"]["max_field_of_view_angle"].GetInt())},
+    HALF_ROVER{static_cast<float>(config["pt_cloud"]["half_rover"].GetInt())},
+    MAX_RANGE{config["pt_cloud"]["pass_through"]["upper_bd_z"].GetFloat()},
+    CAMERA_HEIGHT{static_cast<float>(config["rover_specs"]["zed_height"].GetDouble() * config["mm_per_m"].GetInt())},
+    MIN_HEIGHT{config["depth_obstacle"]["min_height"].GetFloat()},
+    MAX_HEIGHT{config["depth_obstacle"]["max_height"].GetFloat()},
+    MIN_POINTS{config["depth_obstacle"]["min_points"].GetInt()},
+    PITCH{config["depth_obstacle"]["pitch"].GetDouble() * PI / 180},
+    MM_PER_M{static_cast<double>(config["mm_per_m"].GetInt())},
+    leftBearing{0}, rightBearing{0}, distance{-1},
+    cameraModel{config},
+    clearPath{MAX_FIELD_OF_VIEW_ANGLE, config["pt_cloud"]["clear_path"]["bin_size"].GetDouble(),
+              static_cast<double>(HALF_ROVER + config["pt_cloud"]["clear_path"]["buffer"].GetInt())},
+    columnNearest(WIDTH), columnCounts(WIDTH) {
+    obstacleX.reserve(WIDTH);
+    obstacleZ.reserve(WIDTH);
+    cameraModel.setFrameSize(cv::Size(WIDTH, HEIGHT));
+}
+
+void DepthObstacleDetector::setIntrinsics(const CameraIntrinsics &intrinsics) {
+    cameraModel.setIntrinsics(intrinsics);
+}
+
+void DepthObstacleDetector::rowInterval(int v, float &lower, float &upper) const {
+    //A pixel at depth z in this row is h = CAMERA_HEIGHT - k * z above the ground, with k the
+    //downward slope of the row's ray once the camera's pitch is taken out
+    const cv::Mat &K = cameraModel.cameraMatrix();
+    double slope = (v - K.at<double>(1, 2)) / K.at<double>(1, 1);
+    double k = std::sin(PITCH) + slope * std::cos(PITCH);
+
+    double low, high;
+    if (std::fabs(k) < 1e-6) {
+        //The row is level with the camera, everything in it is at camera height
+        bool inBand = CAMERA_HEIGHT > MIN_HEIGHT && CAMERA_HEIGHT < MAX_HEIGHT;
+        low = inBand ? 0 : INFINITY;
+        high = inBand ? INFINITY : 0;
+    } else if (k > 0) {
+        low = (CAMERA_HEIGHT - MAX_HEIGHT) / k;
+        high = (CAMERA_HEIGHT - MIN_HEIGHT) / k;
+    } else {
+        low = (CAMERA_HEIGHT - MIN_HEIGHT) / k;
+        high = (CAMERA_HEIGHT - MAX_HEIGHT) / k;
+    }
+    lower = static_cast<float>(std::max(low, 0.0));
+    upper = static_cast<float>(std::min(high, static_cast<double>(MAX_RANGE)));
+}
+
+void DepthObstacleDetector::accumulateRow(const float *row, float lower, float upper) {
+    //Both compares are false for NaN, and infinite depths are past upper
+    int u = 0;
+#if defined(__AVX__)
+    const __m256 lowerV = _mm256_set1_ps(lower);
+    const __m256 upperV = _mm256_set1_ps(upper);
+    const __m256 infinity = _mm256_set1_ps(INFINITY);
+    const __m256 one = _mm256_set1_ps(1);
+    for (; u + 8 <= WIDTH; u += 8) {
+        __m256 z = _mm256_loadu_ps(row + u);
+        __m256 obstacle = _mm256_and_ps(_mm256_cmp_ps(z, lowerV, _CMP_GT_OQ), _mm256_cmp_ps(z, upperV, _CMP_LT_OQ));
+        __m256 nearest = _mm256_min_ps(_mm256_loadu_ps(&columnNearest[u]), _mm256_blendv_ps(infinity, z, obstacle));
+        _mm256_storeu_ps(&columnNearest[u], nearest);
+        _mm256_storeu_ps(&columnCounts[u], _mm256_add_ps(_mm256_loadu_ps(&columnCounts[u]), _mm256_and_ps(obstacle, one)));
+    }
+#endif
+    for (; u < WIDTH; ++u) {
+        float z = row[u];
+        if (z > lower && z < upper) {
+            columnNearest[u] = std::min(columnNearest[u], z);
+            ++columnCounts[u];
+        }
+    }
+}
+
+void DepthObstacleDetector::detect(const cv::Mat &depth) {
+    //Nearest keeps any NaN as is instead of averaging it into its neighbours
+    cv::resize(depth, downsampled, cv::Size(WIDTH, HEIGHT), 0, 0, cv::INTER_NEAREST);
+
+    std::fill(columnNearest.begin(), columnNearest.end(), INFINITY);
+    std::fill(columnCounts.begin(), columnCounts.end(), 0.0f);
+    for (int v = 0; v < HEIGHT; ++v) {
+        float lower, upper;
+        rowInterval(v, lower, upper);
+        if (lower < upper) {
+            accumulateRow(downsampled.ptr<float>(v), lower, upper);
+        }
+    }
+
+    //Every column that saw enough obstacle pixels is one obstacle point at its nearest depth
+    const cv::Mat &K = cameraModel.cameraMatrix();
+    double fx = K.at<double>(0, 0), cx = K.at<double>(0, 2);
+    obstacleX.clear();
+    obstacleZ.clear();
+    float centerDistance = INFINITY;
+    for (int u = 0; u < WIDTH; ++u) {
+        if (columnCounts[u] < MIN_POINTS) {
+            continue;
+        }
+        float z = columnNearest[u];
+        float x = static_cast<float>((u - cx) / fx * z);
+        obstacleX.push_back(x);
+        obstacleZ.push_back(z);
+        if (std::fabs(x) <= HALF_ROVER) {
+            centerDistance = std::min(centerDistance, z);
+        }
+    }
+
+    //Like PCL, the bearings stay 0 and the distance -1 while the center path is clear
+    if (centerDistance == INFINITY) {
+        leftBearing = 0;
+        rightBearing = 0;
+        distance = -1;
+        return;
+    }
+
+    clearPath.clear();
+    clearPath.addPoints(obstacleX.data(), obstacleZ.data(), obstacleX.size());
+    leftBearing = clearPath.findBearing(0);
+    rightBearing = clearPath.findBearing(1);
+    distance = centerDistance / MM_PER_M;
+}
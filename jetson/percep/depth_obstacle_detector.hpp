@@ -0,0 +1,64 @@
+#pragma once
+
+#include "perception.hpp"
+#include "camera_model.hpp"
+#include "polar_clear_path.hpp"
+
+/* --- Depth Obstacle Detector --- */
+/**
+\brief Finds a clear path straight from the depth image, without building a point cloud
+The depth image is downsampled and swept a row at a time. With the camera's
+height and pitch, the pixels of a row that are between MIN_HEIGHT and
+MAX_HEIGHT above flat ground are exactly those with depth in one interval,
+so every row is a pair of compares per pixel, eight pixels at a time. Each
+column keeps its nearest obstacle depth and how many obstacle pixels it saw.
+Columns with enough of them become one obstacle point each, and those go
+through the same clear path histogram as the point cloud's interest points
+*/
+class DepthObstacleDetector {
+public:
+    //Constants, lengths are in mm like the depth image
+    int WIDTH;
+    int HEIGHT;
+    double MAX_FIELD_OF_VIEW_ANGLE;
+    float HALF_ROVER;
+    float MAX_RANGE;
+    float CAMERA_HEIGHT;
+    float MIN_HEIGHT;
+    float MAX_HEIGHT;
+    int MIN_POINTS;
+    double PITCH;
+    double MM_PER_M;
+
+    //Results of the last detect, the same as PCL's
+    double leftBearing;
+    double rightBearing;
+    double distance;
+
+    //Obstacle points of the last detect in mm, x to the right and z forward, one per blocked column
+    std::vector<float> obstacleX;
+    std::vector<float> obstacleZ;
+
+    //Reads depth_obstacle, and the field of view, rover width and range from pt_cloud
+    DepthObstacleDetector(const rapidjson::Document &config);
+
+    void setIntrinsics(const CameraIntrinsics &intrinsics);
+
+    //depth is the CV_32FC1 depth image in mm, unknown depths NaN or infinite
+    void detect(const cv::Mat &depth);
+
+private:
+    //Depths an obstacle pixel can have in row v of the downsampled image, (lower, upper)
+    void rowInterval(int v, float &lower, float &upper) const;
+
+    //Folds the obstacle pixels of one row into the column statistics
+    void accumulateRow(const float *row, float lower, float upper);
+
+    CameraModel cameraModel;
+    PolarClearPath clearPath;
+
+    //Reused every frame
+    cv::Mat downsampled;
+    std::vector<float> columnNearest;
+    std::vector<float> columnCounts;
+};
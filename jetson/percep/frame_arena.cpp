@@ -0,0 +1,31 @@
+#include "frame_arena.hpp"
+#include <algorithm>
+
+FrameArena::FrameArena(size_t capacity) :
+    block{new char[capacity]}, capacity{capacity}, used{0}, peak{0}, overflowBytes{0} {}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+    size_t start = (used + alignment - 1) & ~(alignment - 1);
+    if (start + bytes <= capacity) {
+        used = start + bytes;
+        peak = std::max(peak, used + overflowBytes);
+        return block.get() + start;
+    }
+
+    //Out of room, fall back to the heap until the next reset grows the block
+    overflow.emplace_back(new char[bytes + alignment]);
+    overflowBytes += bytes + alignment;
+    peak = std::max(peak, used + overflowBytes);
+    size_t address = reinterpret_cast<size_t>(overflow.back().get());
+    return reinterpret_cast<void*>((address + alignment - 1) & ~(alignment - 1));
+}
+
+void FrameArena::reset() {
+    if (!overflow.empty()) {
+        capacity = peak;
+        block.reset(new char[capacity]);
+        overflow.clear();
+        overflowBytes = 0;
+    }
+    used = 0;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/* --- Frame Arena --- */
+/**
+\brief Bump allocator for scratch memory that only lives for one frame
+Allocations are carved out of one block and never freed individually,
+reset() releases everything at once. If a frame needs more than the block
+holds the extra is taken from the heap and the block is grown to fit on
+the next reset, so after the first few frames no heap allocations happen
+*/
+class FrameArena {
+public:
+    explicit FrameArena(size_t capacity);
+
+    //Returns bytes of memory aligned to alignment, valid until the next reset
+    void* allocate(size_t bytes, size_t alignment);
+
+    //Releases every allocation made since the last reset
+    void reset();
+
+    //Most bytes requested in a single frame so far
+    size_t highWaterMark() const { return peak; }
+
+private:
+    std::unique_ptr<char[]> block;
+    size_t capacity;
+    size_t used;
+    size_t peak;
+
+    //Allocations that did not fit in block this frame
+    std::vector<std::unique_ptr<char[]>> overflow;
+    size_t overflowBytes;
+};
+
+/* --- Arena Allocator --- */
+//Standard allocator that draws from a FrameArena, deallocate is a no-op
+//Containers using it must not outlive the frame they were created in
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(FrameArena &arena) : arena{&arena} {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena{other.arena} {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+
+    FrameArena *arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/* --- Cluster Indices --- */
+//Variable length groups of point indices stored back to back
+//Group i holds indices[offsets[i]] up to indices[offsets[i + 1]]
+struct ClusterIndices {
+    ArenaVector<int> indices;
+    ArenaVector<int> offsets;
+
+    explicit ClusterIndices(FrameArena &arena) :
+        indices(ArenaAllocator<int>(arena)), offsets(1, 0, ArenaAllocator<int>(arena)) {}
+
+    size_t size() const { return offsets.size() - 1; }
+    const int* begin(size_t i) const { return indices.data() + offsets[i]; }
+    const int* end(size_t i) const { return indices.data() + offsets[i + 1]; }
+    int count(size_t i) const { return offsets[i + 1] - offsets[i]; }
+
+    void clear() {
+        indices.clear();
+        offsets.assign(1, 0);
+    }
+
+    //Closes the group that has been built at the end of indices
+    void endGroup() { offsets.push_back(static_cast<int>(indices.size())); }
+};
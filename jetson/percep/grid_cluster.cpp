@@ -0,0 +1,163 @@
+#include "grid_cluster.hpp"
+#include "perception.hpp"
+
+#if OBSTACLE_DETECTION
+
+namespace {
+    //Offset keeps cell coordinates positive so they can be packed in 21 bits each
+    const int64_t CELL_OFFSET = 1 << 20;
+    const int CELL_BITS = 21;
+
+    uint64_t packCell(int64_t ix, int64_t iy, int64_t iz) {
+        return (static_cast<uint64_t>(iz + CELL_OFFSET) << (2 * CELL_BITS)) |
+               (static_cast<uint64_t>(iy + CELL_OFFSET) << CELL_BITS) |
+                static_cast<uint64_t>(ix + CELL_OFFSET);
+    }
+
+    int64_t unpackCell(uint64_t key, int axis) {
+        return static_cast<int64_t>((key >> (axis * CELL_BITS)) & ((1u << CELL_BITS) - 1)) - CELL_OFFSET;
+    }
+
+    //The 13 neighbors that come after a cell in key order
+    //Visiting only these plus the cell itself checks every pair of cells once
+    struct CellOffset {
+        int dx, dy, dz;
+    };
+    const CellOffset FORWARD_NEIGHBORS[] = {
+        {1, 0, 0},
+        {-1, 1, 0}, {0, 1, 0}, {1, 1, 0},
+        {-1, -1, 1}, {0, -1, 1}, {1, -1, 1},
+        {-1, 0, 1}, {0, 0, 1}, {1, 0, 1},
+        {-1, 1, 1}, {0, 1, 1}, {1, 1, 1}
+    };
+}
+
+GridClusterExtraction::GridClusterExtraction(float clusterTolerance, int minClusterSize, int maxClusterSize) :
+    tolerance{clusterTolerance}, toleranceSquared{clusterTolerance * clusterTolerance},
+    minClusterSize{minClusterSize}, maxClusterSize{maxClusterSize} {}
+
+int GridClusterExtraction::find(int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+void GridClusterExtraction::merge(int a, int b) {
+    a = find(a);
+    b = find(b);
+    if (a < b) {
+        parent[b] = a;
+    }
+    else if (b < a) {
+        parent[a] = b;
+    }
+}
+
+std::pair<size_t, size_t> GridClusterExtraction::cellRange(uint64_t key) const {
+    auto first = std::lower_bound(cells.begin(), cells.end(), key, [](const CellEntry &cell, uint64_t k) {
+        return cell.key < k;
+    });
+    auto last = first;
+    while (last != cells.end() && last->key == key) {
+        ++last;
+    }
+    return {static_cast<size_t>(first - cells.begin()), static_cast<size_t>(last - cells.begin())};
+}
+
+void GridClusterExtraction::extract(const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+                                    ClusterIndices &cluster_indices) {
+    cluster_indices.clear();
+    const auto &points = cloud.points;
+    const int numPoints = static_cast<int>(points.size());
+    const float inverseTolerance = 1.0f / tolerance;
+
+    //Hash every point into its cell
+    cells.clear();
+    parent.resize(numPoints);
+    for (int i = 0; i < numPoints; ++i) {
+        parent[i] = i;
+        cells.push_back({packCell(static_cast<int64_t>(std::floor(points[i].x * inverseTolerance)),
+                                  static_cast<int64_t>(std::floor(points[i].y * inverseTolerance)),
+                                  static_cast<int64_t>(std::floor(points[i].z * inverseTolerance))), i});
+    }
+    std::sort(cells.begin(), cells.end(), [](const CellEntry &a, const CellEntry &b) {
+        return a.key < b.key;
+    });
+
+    //Merges every pair of points from the two cell ranges that are within the tolerance
+    auto mergeRanges = [&](size_t aFirst, size_t aLast, size_t bFirst, size_t bLast, bool sameCell) {
+        for (size_t a = aFirst; a < aLast; ++a) {
+            const pcl::PointXYZRGB &pa = points[cells[a].index];
+            for (size_t b = sameCell ? a + 1 : bFirst; b < bLast; ++b) {
+                const pcl::PointXYZRGB &pb = points[cells[b].index];
+                float dx = pa.x - pb.x, dy = pa.y - pb.y, dz = pa.z - pb.z;
+                if (dx * dx + dy * dy + dz * dz <= toleranceSquared) {
+                    merge(cells[a].index, cells[b].index);
+                }
+            }
+        }
+    };
+
+    size_t first = 0;
+    while (first < cells.size()) {
+        uint64_t key = cells[first].key;
+        size_t last = first;
+        while (last < cells.size() && cells[last].key == key) {
+            ++last;
+        }
+
+        mergeRanges(first, last, first, last, true);
+
+        int64_t ix = unpackCell(key, 0), iy = unpackCell(key, 1), iz = unpackCell(key, 2);
+        for (const CellOffset &offset : FORWARD_NEIGHBORS) {
+            std::pair<size_t, size_t> neighbor = cellRange(packCell(ix + offset.dx, iy + offset.dy, iz + offset.dz));
+            mergeRanges(first, last, neighbor.first, neighbor.second, false);
+        }
+        first = last;
+    }
+
+    //Size every set and number the ones within bounds in order of their lowest index
+    clusterSize.assign(numPoints, 0);
+    clusterSlot.assign(numPoints, -1);
+    slotRoot.clear();
+    for (int i = 0; i < numPoints; ++i) {
+        ++clusterSize[find(i)];
+    }
+    for (int i = 0; i < numPoints; ++i) {
+        int root = find(i);
+        if (clusterSlot[root] == -1 && clusterSize[root] >= minClusterSize && clusterSize[root] <= maxClusterSize) {
+            clusterSlot[root] = static_cast<int>(slotRoot.size());
+            slotRoot.push_back(root);
+        }
+    }
+
+    //Largest clusters first, ties keep their lowest index order
+    std::sort(slotRoot.begin(), slotRoot.end(), [this](int a, int b) {
+        if (clusterSize[a] != clusterSize[b]) {
+            return clusterSize[a] > clusterSize[b];
+        }
+        return clusterSlot[a] < clusterSlot[b];
+    });
+
+    //Lay the clusters out back to back, then drop every point into its cluster's range
+    slotOffset.resize(slotRoot.size());
+    cluster_indices.offsets.reserve(slotRoot.size() + 1);
+    int offset = 0;
+    for (size_t i = 0; i < slotRoot.size(); ++i) {
+        int root = slotRoot[i];
+        slotOffset[clusterSlot[root]] = offset;
+        offset += clusterSize[root];
+        cluster_indices.offsets.push_back(offset);
+    }
+    cluster_indices.indices.resize(offset);
+    for (int i = 0; i < numPoints; ++i) {
+        int slot = clusterSlot[find(i)];
+        if (slot != -1) {
+            cluster_indices.indices[slotOffset[slot]++] = i;
+        }
+    }
+}
+
+#endif
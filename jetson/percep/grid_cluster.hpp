@@ -0,0 +1,57 @@
+#pragma once
+
+#include "config.h"
+#include "frame_arena.hpp"
+
+#if OBSTACLE_DETECTION
+#include <pcl/point_types.h>
+#include <vector>
+
+/* --- Grid Euclidean Cluster Extraction --- */
+/**
+\brief Euclidean clustering without a KdTree
+Points are hashed into a grid of cubes with side clusterTolerance, so
+every neighbor of a point within the tolerance is in its own cube or
+one of the 26 around it. Neighboring points are merged with union-find
+and clusters outside of [minClusterSize, maxClusterSize] are dropped,
+giving the same clusters as pcl::EuclideanClusterExtraction
+*/
+class GridClusterExtraction {
+public:
+    GridClusterExtraction(float clusterTolerance, int minClusterSize, int maxClusterSize);
+
+    //Output matches pcl::EuclideanClusterExtraction: indices within a cluster are
+    //ascending and clusters are ordered from largest to smallest
+    void extract(const pcl::PointCloud<pcl::PointXYZRGB> &cloud, ClusterIndices &cluster_indices);
+
+private:
+    //Grid cell a point falls in, packed z-major so sorting groups each cell
+    struct CellEntry {
+        uint64_t key;
+        int index;
+    };
+
+    //Returns the root of the set containing i, halving the path on the way
+    int find(int i);
+
+    //Merges the sets of a and b, the smaller index always becomes the root
+    void merge(int a, int b);
+
+    //Returns the range of cells holding key, empty if there are none
+    std::pair<size_t, size_t> cellRange(uint64_t key) const;
+
+    float tolerance;
+    float toleranceSquared;
+    int minClusterSize;
+    int maxClusterSize;
+
+    //Scratch buffers, kept between frames so extraction does not reallocate
+    std::vector<CellEntry> cells;
+    std::vector<int> parent;
+    std::vector<int> clusterSize;
+    std::vector<int> clusterSlot;
+    std::vector<int> slotRoot;
+    std::vector<int> slotOffset;
+};
+
+#endif
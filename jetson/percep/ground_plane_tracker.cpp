@@ -0,0 +1,91 @@
+#include "ground_plane_tracker.hpp"
+#include "perception.hpp"
+
+#if OBSTACLE_DETECTION
+
+GroundPlaneTracker::GroundPlaneTracker(double distanceThreshold, double maxAngle, double minInlierRatio,
+                                       int maxTrackedFrames, int ransacIterations) :
+    distanceThreshold{distanceThreshold}, maxAngle{maxAngle}, minInlierRatio{minInlierRatio},
+    maxTrackedFrames{maxTrackedFrames}, ransacIterations{ransacIterations},
+    hasPlane{false}, normal{0, 1, 0}, offset{0}, referenceRatio{0}, trackedFrames{0} {}
+
+bool GroundPlaneTracker::track(const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+                               pcl::ModelCoefficients &coefficients, pcl::PointIndices &inliers) {
+    frameStats.lastFrameTracked = false;
+    frameStats.lastInlierRatio = 0;
+    frameStats.lastIterationsSaved = 0;
+
+    if (!hasPlane || trackedFrames >= maxTrackedFrames || cloud.points.empty()) {
+        return false;
+    }
+
+    //Collect the inliers of the previous plane along with the sums needed to refit it
+    inliers.indices.clear();
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d products = Eigen::Matrix3d::Zero();
+    const auto &points = cloud.points;
+    for (int i = 0; i < static_cast<int>(points.size()); ++i) {
+        Eigen::Vector3f p(points[i].x, points[i].y, points[i].z);
+        if (std::abs(normal.dot(p) + offset) <= distanceThreshold) {
+            inliers.indices.push_back(i);
+            Eigen::Vector3d pd = p.cast<double>();
+            sum += pd;
+            products += pd * pd.transpose();
+        }
+    }
+
+    double ratio = static_cast<double>(inliers.indices.size()) / points.size();
+    frameStats.lastInlierRatio = ratio;
+    if (inliers.indices.size() < 3 || ratio < minInlierRatio * referenceRatio) {
+        return false;
+    }
+
+    //Least squares plane through the inliers: the centroid and the direction of least variance
+    double count = static_cast<double>(inliers.indices.size());
+    Eigen::Vector3d centroid = sum / count;
+    Eigen::Matrix3d covariance = products / count - centroid * centroid.transpose();
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+    Eigen::Vector3f refit = solver.eigenvectors().col(0).cast<float>();
+    if (refit.dot(normal) < 0) {
+        refit = -refit;
+    }
+
+    //The refit has to stay as close to level as RANSAC would allow
+    if (std::acos(std::min(1.0f, std::abs(refit.y()))) > maxAngle) {
+        return false;
+    }
+
+    normal = refit;
+    offset = -normal.dot(centroid.cast<float>());
+    coefficients.values.assign({normal.x(), normal.y(), normal.z(), offset});
+
+    ++trackedFrames;
+    frameStats.lastFrameTracked = true;
+    frameStats.lastIterationsSaved = ransacIterations;
+    ++frameStats.framesTracked;
+    frameStats.iterationsSaved += ransacIterations;
+    return true;
+}
+
+void GroundPlaneTracker::reset(const pcl::ModelCoefficients &coefficients,
+                               const pcl::PointIndices &inliers, size_t cloudSize) {
+    trackedFrames = 0;
+    ++frameStats.framesRefreshed;
+    hasPlane = coefficients.values.size() == 4 && cloudSize != 0;
+    if (!hasPlane) {
+        return;
+    }
+
+    Eigen::Vector3f n(coefficients.values[0], coefficients.values[1], coefficients.values[2]);
+    float length = n.norm();
+    hasPlane = length > 0;
+    if (!hasPlane) {
+        return;
+    }
+    normal = n / length;
+    offset = coefficients.values[3] / length;
+    referenceRatio = static_cast<double>(inliers.indices.size()) / cloudSize;
+    frameStats.lastInlierRatio = referenceRatio;
+}
+
+#endif
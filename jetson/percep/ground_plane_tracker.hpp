@@ -0,0 +1,66 @@
+#pragma once
+
+#include "config.h"
+
+#if OBSTACLE_DETECTION
+#include <pcl/point_types.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
+#include <Eigen/Dense>
+
+/* --- Ground Plane Tracker --- */
+/**
+\brief Carries the ground plane from one frame to the next
+The ground barely moves between frames, so before running RANSAC the
+previous plane is checked against the new cloud. If it still explains
+enough of the points it is refit to its inliers by least squares and
+kept, otherwise the caller runs full RANSAC and hands the result back
+through reset(). A full RANSAC is also forced every maxTrackedFrames
+frames so small errors in the refit can't accumulate
+*/
+class GroundPlaneTracker {
+public:
+    //Per frame and running totals of how often tracking replaced RANSAC
+    struct Stats {
+        bool lastFrameTracked = false;
+        double lastInlierRatio = 0;
+        int lastIterationsSaved = 0;
+        long framesTracked = 0;
+        long framesRefreshed = 0;
+        long iterationsSaved = 0;
+    };
+
+    //minInlierRatio is relative to the inlier ratio of the last full RANSAC,
+    //maxAngle is how far in radians the refit normal may tilt from the y axis
+    GroundPlaneTracker(double distanceThreshold, double maxAngle, double minInlierRatio,
+                       int maxTrackedFrames, int ransacIterations);
+
+    //Fills coefficients and inliers from the previous plane, returns false if full RANSAC is needed
+    bool track(const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+               pcl::ModelCoefficients &coefficients, pcl::PointIndices &inliers);
+
+    //Starts tracking the plane a full RANSAC found, an empty model stops tracking
+    void reset(const pcl::ModelCoefficients &coefficients, const pcl::PointIndices &inliers, size_t cloudSize);
+
+    const Stats& stats() const { return frameStats; }
+
+private:
+    double distanceThreshold;
+    double maxAngle;
+    double minInlierRatio;
+    int maxTrackedFrames;
+    int ransacIterations;
+
+    //Unit normal and offset of the tracked plane, valid if hasPlane
+    bool hasPlane;
+    Eigen::Vector3f normal;
+    float offset;
+
+    //Inlier ratio of the last full RANSAC and frames tracked since
+    double referenceRatio;
+    int trackedFrames;
+
+    Stats frameStats;
+};
+
+#endif
@@ -1,15 +1,102 @@
 #include "perception.hpp"
+#include "pipeline.hpp"
+#include "depth_obstacle_detector.hpp"
+#include "occupancy_grid.hpp"
+#include "telemetry.hpp"
 #include "rover_msgs/Target.hpp"
 #include "rover_msgs/TargetList.hpp"
+#include "rover_msgs/NavStatus.hpp"
+#include "rover_msgs/Odometry.hpp"
 #include <unistd.h>
+#include <atomic>
+#include <mutex>
 #include <deque>
+#include <cassert>
 
 using namespace cv;
 using namespace std;
 using namespace std::chrono_literals;
- 
+
+//Tracks whether nav is spinning in place looking for tags, AR detection favors frame rate while it is
+class NavStatusHandler {
+public:
+    atomic<bool> spinning{false};
+
+    void handle(const lcm::ReceiveBuffer*, const string&, const rover_msgs::NavStatus *navStatus) {
+        const string &state = navStatus->nav_state_name;
+        spinning.store(state == "Search Spin" || state == "Search Spin Wait" ||
+                       state == "Gate Spin" || state == "Gate Spin Wait");
+    }
+};
+
+//Keeps the recent GPS poses as mm east and north of the first fix, for the occupancy grid to scroll by
+//Each pose is stamped when it arrives so a frame can be placed where the rover was when it was captured
+class OdometryHandler {
+public:
+    OdometryHandler(double mmPerM, double historySeconds) :
+        mmPerM{mmPerM}, history{static_cast<int64_t>(historySeconds * 1e6)} {}
+
+    void handle(const lcm::ReceiveBuffer*, const string&, const rover_msgs::Odometry *odometry) {
+        double latitude = (odometry->latitude_deg + odometry->latitude_min / 60) * PI / 180;
+        double longitude = (odometry->longitude_deg + odometry->longitude_min / 60) * PI / 180;
+        lock_guard<mutex> lock(poseMutex);
+        if (!haveOrigin) {
+            originLatitude = latitude;
+            originLongitude = longitude;
+            haveOrigin = true;
+        }
+        //Flat earth is plenty over the distances the grid covers
+        Pose pose;
+        pose.time = microsecondsSinceEpoch();
+        pose.east = (longitude - originLongitude) * cos(originLatitude) * EARTH_RADIUS * mmPerM;
+        pose.north = (latitude - originLatitude) * EARTH_RADIUS * mmPerM;
+        pose.heading = odometry->bearing_deg;
+        poses.push_back(pose);
+
+        //One pose older than the history is kept so there is always one from before any recent frame
+        while (poses.size() > 1 && pose.time - poses[1].time > history) {
+            poses.pop_front();
+        }
+    }
+
+    //Pose from the last fix that arrived before time, microseconds since the epoch
+    void pose(int64_t time, double &outEast, double &outNorth, double &outHeading) {
+        lock_guard<mutex> lock(poseMutex);
+        Pose match{0, 0, 0, 0};
+        if (!poses.empty()) {
+            match = poses.front();
+        }
+        for (const Pose &pose : poses) {
+            if (pose.time > time) {
+                break;
+            }
+            match = pose;
+        }
+        outEast = match.east;
+        outNorth = match.north;
+        outHeading = match.heading;
+    }
+
+private:
+    static constexpr double EARTH_RADIUS = 6371000;
+
+    struct Pose {
+        int64_t time;
+        double east;
+        double north;
+        double heading;
+    };
+
+    double mmPerM;
+    int64_t history;
+    mutex poseMutex;
+    bool haveOrigin = false;
+    double originLatitude = 0, originLongitude = 0;
+    deque<Pose> poses;
+};
+
 int main() {
-  
+
  /* --- Reading in Config File --- */
   rapidjson::Document mRoverConfig;
   ifstream configFile;
@@ -26,18 +113,8 @@ int main() {
 
   /* --- Camera Initializations --- */
     Camera cam(mRoverConfig);
-    int iterations = 0;
     cam.grab();
 
-    #if PERCEPTION_DEBUG
-        namedWindow("depth", 2);
-    #endif
-    
-    #if AR_DETECTION
-    Mat rgb;
-    Mat src = cam.image();
-    #endif
-
     #if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
         cam.disk_record_init();
     #endif
@@ -45,36 +122,42 @@ int main() {
     /* -- LCM Messages Initializations -- */
     lcm::LCM lcm_;
     rover_msgs::TargetList arTagsMessage;
-    rover_msgs::Target* arTags = arTagsMessage.targetList;
     rover_msgs::Obstacle obstacleMessage;
-    arTags[0].distance = mRoverConfig["ar_tag"]["default_tag_val"].GetInt();
-    arTags[1].distance = mRoverConfig["ar_tag"]["default_tag_val"].GetInt();
+    arTagsMessage.num_targets = 0;
+    NavStatusHandler navStatusHandler;
+    lcm_.subscribe("/nav_status", &NavStatusHandler::handle, &navStatusHandler);
+    OdometryHandler odometryHandler(mRoverConfig["mm_per_m"].GetInt(),
+                                    mRoverConfig["occupancy_grid"]["pose_history"].GetDouble());
+    lcm_.subscribe("/odometry", &OdometryHandler::handle, &odometryHandler);
+
+    //Every stage records how long it took, the summaries go out on /perception_telemetry
+    Telemetry telemetry(mRoverConfig);
+    rover_msgs::PerceptionTelemetry telemetryMessage;
 
-    /* --- AR Tag Initializations --- */
-    TagDetector detector(mRoverConfig);
-    pair<Tag, Tag> tagPair;
-    
     /* --- Point Cloud Initializations --- */
     #if OBSTACLE_DETECTION
 
-    PCL pointcloud(mRoverConfig);
     enum viewerType {
         newView, //set to 0 -or false- to be passed into updateViewer later
         originalView //set to 1 -or true- to be passed into updateViewer later
     };
 
-    /* --- Outlier Detection --- */
-    int numChecks = 3;
-    deque <bool> outliers;
-    outliers.resize(numChecks, true); //initializes outliers vector
-    deque <bool> checkTrue(numChecks, true); //true deque to check our outliers deque against
-    deque <bool> checkFalse(numChecks, false); //false deque to check our outliers deque against
-    obstacle_return lastObstacle;
+    //Obstacles come from the point cloud unless the depth image engine is picked, which skips building a cloud
+    const bool DEPTH_OBSTACLES = string(mRoverConfig["pipeline"]["obstacle_engine"].GetString()) == "depth";
 
+    //The point cloud stages time themselves, print and show the viewers only when debugging
+    const bool DEBUG_OBSTACLES = PERCEPTION_DEBUG || mRoverConfig["pt_cloud"]["debug"].GetInt();
+
+    #endif
+
+    #if AR_DETECTION || OBSTACLE_DETECTION
+    //Both detection stages use the camera's own calibration when it has one
+    CameraIntrinsics intrinsics;
+    const bool HAVE_INTRINSICS = cam.intrinsics(intrinsics);
     #endif
 
-    /* --- AR Recording Initializations and Implementation--- */ 
-    
+    /* --- AR Recording Initializations and Implementation--- */
+
     time_t now = time(0);
     char* ltm = ctime(&now);
     string timeStamp(ltm);
@@ -84,115 +167,313 @@ int main() {
     cam.record_ar_init();
     #endif
 
-  /* --- Main Processing Stuff --- */
-  while (true) {
-        //Check to see if we were able to grab the frame
-        if (!cam.grab()) break;
+    /* --- Pipeline Initializations --- */
+    //Capture, AR tag detection and obstacle detection each run on their own thread
+    //Frames flow through bounded queues, a nullptr frame tells a stage to shut down
+    //Both detection stages see every frame in order so their results pair up by frame id
+    const int FRAME_QUEUE_DEPTH = mRoverConfig["pipeline"]["frame_queue_depth"].GetInt();
+    vector<Frame> framePool(FRAME_QUEUE_DEPTH + 2);
+    BoundedQueue<Frame*> freeFrames(framePool.size());
+    for (Frame &frame : framePool) {
+        freeFrames.push(&frame);
+    }
 
-        #if AR_DETECTION
-        //Grab initial images from cameras
-        Mat rgb;
-        Mat src = cam.image();
-        Mat depth_img = cam.depth();
-        #endif
+    BoundedQueue<Frame*> arFrames(FRAME_QUEUE_DEPTH);
+    BoundedQueue<Frame*> obstacleFrames(FRAME_QUEUE_DEPTH);
+    BoundedQueue<ArResult> arResults(FRAME_QUEUE_DEPTH);
+    BoundedQueue<ObstacleResult> obstacleResults(FRAME_QUEUE_DEPTH);
 
-        #if OBSTACLE_DETECTION
-        //Update Point Cloud
-        pointcloud.update();
-        cam.getDataCloud(pointcloud.pt_cloud_ptr);
-        #endif
+    #if !AR_DETECTION && !OBSTACLE_DETECTION
+    //With no detection stage main takes frames straight from capture
+    BoundedQueue<Frame*> capturedFrames(FRAME_QUEUE_DEPTH);
+    #endif
+
+    /* --- Capture Stage --- */
+    thread captureThread([&] {
+        int iterations = 0;
+        while (true) {
+            Frame *frame = freeFrames.pop();
+            double captureMs;
+            StageTimer captureTimer(captureMs);
+
+            //Check to see if we were able to grab the frame
+            if (!cam.grab()) {
+                #if AR_DETECTION
+                arFrames.push(nullptr);
+                #endif
+                #if OBSTACLE_DETECTION
+                obstacleFrames.push(nullptr);
+                #endif
+                #if !AR_DETECTION && !OBSTACLE_DETECTION
+                capturedFrames.push(nullptr);
+                #endif
+                break;
+            }
+            telemetry.setDroppedFrames(cam.droppedFrames());
+            frame->id = iterations;
+            frame->timestamp = cam.timestamp();
+
+            #if AR_DETECTION
+            //Grab initial images from cameras, copied since the camera reuses its buffers
+            cam.image().copyTo(frame->src);
+            cam.depth().copyTo(frame->depth_img);
+            #endif
+
+            #if OBSTACLE_DETECTION
+            if (DEPTH_OBSTACLES && !WRITE_CURR_FRAME_TO_DISK) {
+                #if !AR_DETECTION
+                cam.depth().copyTo(frame->depth_img);
+                #endif
+            } else {
+                //Update Point Cloud
+                cam.getDataCloud(frame->cloud);
+            }
+            #endif
+            captureTimer.stop();
+            telemetry.record(LANE_CAPTURE, TELEMETRY_CAPTURE, captureMs);
 
-        #if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
-        int FRAME_WRITE_INTERVAL = mRoverConfig["camera"]["frame_write_interval"].GetInt();
-            if (iterations % FRAME_WRITE_INTERVAL == 0) {
-                Mat rgb_copy = src.clone(), depth_copy = depth_img.clone();
+            #if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
+            if (iterations % cam.FRAME_WRITE_INTERVAL == 0) {
+                Mat rgb_copy = frame->src.clone(), depth_copy = frame->depth_img.clone();
                 #if PERCEPTION_DEBUG
                     cout << "Copied correctly" << endl;
                 #endif
-                cam.write_curr_frame_to_disk(rgb_copy, depth_copy, pointcloud.pt_cloud_ptr, iterations);
+                cam.write_curr_frame_to_disk(rgb_copy, depth_copy, frame->cloud, iterations);
+            }
+            #endif
+
+            #if AR_DETECTION
+            arFrames.push(frame);
+            #endif
+            #if OBSTACLE_DETECTION
+            obstacleFrames.push(frame);
+            #endif
+            #if !AR_DETECTION && !OBSTACLE_DETECTION
+            capturedFrames.push(frame);
+            #endif
+
+            #if !ZED_SDK_PRESENT
+                std::this_thread::sleep_for(0.2s); // Iteration speed control not needed when using camera
+            #endif
+
+            ++iterations;
+        }
+    });
+
+    /* --- AR Tag Stage --- */
+    #if AR_DETECTION
+    thread arThread([&] {
+        TagDetector detector(mRoverConfig);
+        if (HAVE_INTRINSICS) {
+            detector.setIntrinsics(intrinsics);
         }
+        vector<Tag> tags;
+        ArResult result;
+        result.targets.num_targets = 0;
+
+        //Every HighGUI call stays on this thread, including the ones in findARTags
+        #if PERCEPTION_DEBUG
+            namedWindow("depth", 2);
         #endif
 
-        /* --- AR Tag Processing --- */
-        arTags[0].distance = mRoverConfig["ar_tag"]["default_tag_val"].GetInt();
-        arTags[1].distance = mRoverConfig["ar_tag"]["default_tag_val"].GetInt();
-        #if AR_DETECTION
-            tagPair = detector.findARTags(src, depth_img, rgb);
+        while (Frame *frame = arFrames.pop()) {
+            Mat rgb;
+            double arMs;
+            StageTimer arTimer(arMs);
+
+            detector.setCoarseSearch(navStatusHandler.spinning.load());
+            tags = detector.findARTags(frame->src, frame->depth_img, rgb);
             #if AR_RECORD
                 cam.record_ar(rgb);
             #endif
 
-            detector.updateDetectedTagInfo(arTags, tagPair, depth_img, src);
+            //The target list is kept between frames, it holds the last tags for a few frames after they're lost
+            detector.updateDetectedTagInfo(result.targets, tags, frame->depth_img, frame->src, frame->timestamp);
+            arTimer.stop();
+            telemetry.record(LANE_AR_TAGS, TELEMETRY_AR_TAGS, arMs);
 
-        #if PERCEPTION_DEBUG && AR_DETECTION
-            imshow("depth", src);
-            waitKey(1);  
-        #endif
+            #if PERCEPTION_DEBUG
+                imshow("depth", frame->src);
+                waitKey(1);
+            #endif
+
+            result.frame = frame;
+            arResults.push(result);
+        }
+        arResults.push(ArResult{nullptr, rover_msgs::TargetList()});
+    });
+    #endif
 
+    /* --- Point Cloud Stage --- */
+    #if OBSTACLE_DETECTION
+    thread obstacleThread([&] {
+        #if !WRITE_CURR_FRAME_TO_DISK
+        //Each frame's obstacles go into the occupancy grid and the path is found on the grid,
+        //so a single frame that misses or imagines an obstacle doesn't flip the path
+        OccupancyGrid grid(mRoverConfig);
+        auto fuse = [&](const vector<float> &x, const vector<float> &z, int64_t timestamp) {
+            double gridMs;
+            StageTimer gridTimer(gridMs);
+            double east, north, heading;
+            odometryHandler.pose(timestamp, east, north, heading);
+            grid.setPose(east, north, heading);
+            grid.update(x.data(), z.data(), x.size());
+            obstacle_return obstacle = grid.findClearPath();
+            gridTimer.stop();
+            telemetry.record(LANE_OBSTACLES, TELEMETRY_OCCUPANCY_GRID, gridMs, x.size(), grid.occupiedCells());
+            return obstacle;
+        };
         #endif
 
-        /* --- Point Cloud Processing --- */
-        #if OBSTACLE_DETECTION && !WRITE_CURR_FRAME_TO_DISK
-        
-        #if PERCEPTION_DEBUG
-            //Update Original 3D Viewer
-            pointcloud.updateViewer(originalView);
-            cout<<"Original W: " <<pointcloud.pt_cloud_ptr->width<<" Original H: "<<pointcloud.pt_cloud_ptr->height<<endl;
+        /* --- Depth Image Engine --- */
+        if (DEPTH_OBSTACLES) {
+            DepthObstacleDetector depthDetector(mRoverConfig);
+            if (HAVE_INTRINSICS) {
+                depthDetector.setIntrinsics(intrinsics);
+            }
+
+            while (Frame *frame = obstacleFrames.pop()) {
+                obstacle_return obstacle;
+                #if !WRITE_CURR_FRAME_TO_DISK
+                double detectMs;
+                StageTimer detectTimer(detectMs);
+                depthDetector.detect(frame->depth_img);
+                detectTimer.stop();
+                telemetry.record(LANE_OBSTACLES, TELEMETRY_OBSTACLES, detectMs,
+                                 frame->depth_img.total(), depthDetector.obstacleX.size());
+                obstacle = fuse(depthDetector.obstacleX, depthDetector.obstacleZ, frame->timestamp);
+                #endif
+
+                obstacleResults.push(ObstacleResult{frame, obstacle});
+            }
+            obstacleResults.push(ObstacleResult{nullptr, obstacle_return()});
+            return;
+        }
+
+        /* --- Point Cloud Engine --- */
+        //Runs for either pipeline, PCL<DebugSink> or PCL<NullSink>
+        auto runPointCloud = [&](auto &pointcloud) {
+            while (Frame *frame = obstacleFrames.pop()) {
+                obstacle_return obstacle;
+                #if !WRITE_CURR_FRAME_TO_DISK
+                //Take the frame's cloud, the frame gets the previous buffer back to refill later
+                pointcloud.pt_cloud_ptr.swap(frame->cloud);
+
+                if (DEBUG_OBSTACLES) {
+                    //Update Original 3D Viewer
+                    pointcloud.updateViewer(originalView);
+                    cout<<"Original W: " <<pointcloud.pt_cloud_ptr->width<<" Original H: "<<pointcloud.pt_cloud_ptr->height<<endl;
+                }
+
+                //Run Obstacle Detection
+                double detectMs;
+                StageTimer detectTimer(detectMs);
+                pointcloud.pcl_obstacle_detection();
+                detectTimer.stop();
+                telemetry.record(LANE_OBSTACLES, TELEMETRY_OBSTACLES, detectMs,
+                                 pointcloud.stagePointsIn[STAGE_PASS_THROUGH], pointcloud.obstacleX.size());
+                for (int stage = 0; stage < NUM_OBSTACLE_STAGES; ++stage) {
+                    telemetry.record(LANE_OBSTACLES, TELEMETRY_POINT_CLOUD + stage, pointcloud.stageTimes[stage],
+                                     pointcloud.stagePointsIn[stage], pointcloud.stagePointsOut[stage]);
+                }
+                obstacle = fuse(pointcloud.obstacleX, pointcloud.obstacleZ, frame->timestamp);
+
+                if (DEBUG_OBSTACLES) {
+                    //Update Processed 3D Viewer
+                    pointcloud.updateViewer(newView);
+                    cout<<"Downsampled W: " <<pointcloud.pt_cloud_ptr->width<<" Downsampled H: "<<pointcloud.pt_cloud_ptr->height<<endl;
+                }
+                #endif
+
+                obstacleResults.push(ObstacleResult{frame, obstacle});
+            }
+            obstacleResults.push(ObstacleResult{nullptr, obstacle_return()});
+        };
+
+        if (DEBUG_OBSTACLES) {
+            PCL<DebugSink> pointcloud(mRoverConfig);
+            runPointCloud(pointcloud);
+        } else {
+            PCL<NullSink> pointcloud(mRoverConfig);
+            runPointCloud(pointcloud);
+        }
+    });
+    #endif
+
+  /* --- Main Processing Stuff --- */
+  //Joins the results of both detection stages for a frame and publishes them
+  while (true) {
+        Frame *frame = nullptr;
+
+        #if !AR_DETECTION && !OBSTACLE_DETECTION
+        frame = capturedFrames.pop();
         #endif
 
-        //Run Obstacle Detection
-        pointcloud.pcl_obstacle_detection();  
-        obstacle_return obstacleOutput (pointcloud.leftBearing, pointcloud.rightBearing, pointcloud.distance);
+        /* --- AR Tag Results --- */
+        #if AR_DETECTION
+        ArResult arResult = arResults.pop();
+        frame = arResult.frame;
+        arTagsMessage = arResult.targets;
+        #endif
 
-        //Outlier Detection Processing
-        outliers.pop_back(); //Remove outdated outlier value
+        /* --- Point Cloud Results --- */
+        #if OBSTACLE_DETECTION
+        ObstacleResult obstacleResult = obstacleResults.pop();
+        frame = obstacleResult.frame;
+        #if AR_DETECTION
+        assert(arResult.frame == obstacleResult.frame);
+        #endif
+        #endif
 
-        if(pointcloud.leftBearing > 0.05 || pointcloud.leftBearing < -0.05)
-            outliers.push_front(true);//if an obstacle is detected in front
-        else 
-            outliers.push_front(false); //obstacle is not detected
+        if (!frame) break;
 
-        if(outliers == checkTrue) //If past iterations see obstacles
-            lastObstacle = obstacleOutput;
-        else if (outliers == checkFalse) // If our iterations see no obstacles after seeing obstacles
-            lastObstacle = obstacleOutput;
+        #if OBSTACLE_DETECTION && !WRITE_CURR_FRAME_TO_DISK
+        obstacle_return &obstacleOutput = obstacleResult.obstacle;
 
-        //Update LCM 
-        obstacleMessage.bearing = lastObstacle.leftBearing; // Update LCM bearing field
-        obstacleMessage.rightBearing = lastObstacle.rightBearing;
-        obstacleMessage.distance = lastObstacle.distance; // Update LCM distance field
+        //Update LCM, the grid already smoothed the path over frames
+        obstacleMessage.bearing = obstacleOutput.leftBearing; // Update LCM bearing field
+        obstacleMessage.rightBearing = obstacleOutput.rightBearing;
+        obstacleMessage.distance = obstacleOutput.distance; // Update LCM distance field
         #if PERCEPTION_DEBUG
             cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!Path Sent: " << obstacleMessage.bearing << "\n";
             cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!Distance Sent: " << obstacleMessage.distance << "\n";
         #endif
-
-        #if PERCEPTION_DEBUG
-        //Update Processed 3D Viewer
-        pointcloud.updateViewer(newView);
-        #if PERCEPTION_DEBUG
-            cout<<"Downsampled W: " <<pointcloud.pt_cloud_ptr->width<<" Downsampled H: "<<pointcloud.pt_cloud_ptr->height<<endl;
-        #endif
         #endif
-        
-        #endif
-        
+
         /* --- Publish LCMs --- */
+        //Both messages carry when their frame was captured so nav can tell how old they are
+        arTagsMessage.timestamp = obstacleMessage.timestamp = frame->timestamp;
+        arTagsMessage.frame_id = obstacleMessage.frame_id = frame->id;
         lcm_.publish("/target_list", &arTagsMessage);
         lcm_.publish("/obstacle", &obstacleMessage);
+        if (telemetry.poll(telemetryMessage)) {
+            lcm_.publish("/perception_telemetry", &telemetryMessage);
+        }
 
-        #if !ZED_SDK_PRESENT
-            std::this_thread::sleep_for(0.2s); // Iteration speed control not needed when using camera 
-        #endif
-        
-        ++iterations;
-  }
+        //Drain every message that came in since the last frame without blocking, nav publishes
+        //its status for each message it handles so handling one per frame falls further behind
+        while (lcm_.handleTimeout(0) > 0) {}
 
+        //Both stages are done with the frame, hand it back to capture
+        freeFrames.push(frame);
+  }
 
     /* --- Wrap Things Up --- */
+    captureThread.join();
+    #if AR_DETECTION
+        arThread.join();
+    #endif
+    #if OBSTACLE_DETECTION
+        obstacleThread.join();
+    #endif
+
     #if AR_RECORD
         cam.record_ar_finish();
     #endif
-  
+
+    #if WRITE_CURR_FRAME_TO_DISK && AR_DETECTION && OBSTACLE_DETECTION
+        cam.disk_record_finish();
+    #endif
+
     return 0;
 }
-
@@ -0,0 +1,181 @@
+#include "occupancy_grid.hpp"
+#include "perception.hpp"
+#include <cmath>
+
+OccupancyGrid::OccupancyGrid(const rapidjson::Document &config) :
+    SIZE{config["occupancy_grid"]["size"].GetInt()},
+    CELL_SIZE{config["occupancy_grid"]["cell_size"].GetFloat()},
+    HIT{config["occupancy_grid"]["hit"].GetFloat()},
+    MISS{config["occupancy_grid"]["miss"].GetFloat()},
+    MIN_LOG_ODDS{config["occupancy_grid"]["min_log_odds"].GetFloat()},
+    MAX_LOG_ODDS{config["occupancy_grid"]["max_log_odds"].GetFloat()},
+    OCCUPIED{config["occupancy_grid"]["occupied"].GetFloat()},
+    MIN_RANGE{config["occupancy_grid"]["min_range"].GetFloat()},
+    UNSEEN_DECAY{config["occupancy_grid"]["unseen_decay"].GetFloat()},
+    MAX_RANGE{config["pt_cloud"]["pass_through"]["upper_bd_z"].GetFloat()},
+    MAX_FIELD_OF_VIEW_ANGLE{static_cast<double>(config["pt_cloud"]["max_field_of_view_angle"].GetInt())},
+    BIN_SIZE{config["occupancy_grid"]["bin_size"].GetDouble()},
+    HALF_ROVER{static_cast<float>(config["pt_cloud"]["half_rover"].GetInt())},
+    MM_PER_M{static_cast<double>(config["mm_per_m"].GetInt())},
+    logOdds(SIZE * SIZE, 0), lastHit(SIZE * SIZE, -1), frame{0},
+    left{0}, bottom{0}, placed{false},
+    east{0}, north{0}, sinHeading{0}, cosHeading{1},
+    nearestHit(static_cast<size_t>(std::ceil(2 * MAX_FIELD_OF_VIEW_ANGLE / BIN_SIZE)), 0),
+    clearPath{MAX_FIELD_OF_VIEW_ANGLE, config["pt_cloud"]["clear_path"]["bin_size"].GetDouble(),
+              static_cast<double>(HALF_ROVER + config["pt_cloud"]["clear_path"]["buffer"].GetInt())} {
+    occupiedX.reserve(SIZE * SIZE);
+    occupiedZ.reserve(SIZE * SIZE);
+    scrollTo(0, 0);
+}
+
+void OccupancyGrid::clear() {
+    std::fill(logOdds.begin(), logOdds.end(), 0.0f);
+    std::fill(lastHit.begin(), lastHit.end(), -1);
+    placed = false;
+    scrollTo(static_cast<int>(std::floor(east / CELL_SIZE)), static_cast<int>(std::floor(north / CELL_SIZE)));
+}
+
+int OccupancyGrid::index(int i, int j) const {
+    int column = i % SIZE, row = j % SIZE;
+    column += column < 0 ? SIZE : 0;
+    row += row < 0 ? SIZE : 0;
+    return row * SIZE + column;
+}
+
+void OccupancyGrid::scrollTo(int i, int j) {
+    int newLeft = i - SIZE / 2, newBottom = j - SIZE / 2;
+    if (!placed || std::abs(newLeft - left) >= SIZE || std::abs(newBottom - bottom) >= SIZE) {
+        std::fill(logOdds.begin(), logOdds.end(), 0.0f);
+        left = newLeft;
+        bottom = newBottom;
+        placed = true;
+        return;
+    }
+
+    //Columns and rows that scroll into view share storage with the ones that left it
+    for (; left < newLeft; ++left) {
+        for (int row = 0; row < SIZE; ++row) {
+            logOdds[index(left, bottom + row)] = 0;
+        }
+    }
+    for (; left > newLeft; --left) {
+        for (int row = 0; row < SIZE; ++row) {
+            logOdds[index(left - 1 + SIZE, bottom + row)] = 0;
+        }
+    }
+    for (; bottom < newBottom; ++bottom) {
+        for (int column = 0; column < SIZE; ++column) {
+            logOdds[index(left + column, bottom)] = 0;
+        }
+    }
+    for (; bottom > newBottom; --bottom) {
+        for (int column = 0; column < SIZE; ++column) {
+            logOdds[index(left + column, bottom - 1 + SIZE)] = 0;
+        }
+    }
+}
+
+void OccupancyGrid::setPose(double newEast, double newNorth, double heading) {
+    east = newEast;
+    north = newNorth;
+    sinHeading = std::sin(heading * PI / 180);
+    cosHeading = std::cos(heading * PI / 180);
+    scrollTo(static_cast<int>(std::floor(east / CELL_SIZE)), static_cast<int>(std::floor(north / CELL_SIZE)));
+}
+
+void OccupancyGrid::toRover(int i, int j, float &x, float &z) const {
+    double dEast = (i + 0.5) * CELL_SIZE - east;
+    double dNorth = (j + 0.5) * CELL_SIZE - north;
+    x = static_cast<float>(dEast * cosHeading - dNorth * sinHeading);
+    z = static_cast<float>(dEast * sinHeading + dNorth * cosHeading);
+}
+
+void OccupancyGrid::update(const float *x, const float *z, size_t count) {
+    ++frame;
+
+    //The camera can't see past the nearest point at each bearing
+    std::fill(nearestHit.begin(), nearestHit.end(), MAX_RANGE);
+    int numBins = static_cast<int>(nearestHit.size());
+    auto binOf = [&](double angle) {
+        int bin = static_cast<int>(std::floor((angle + MAX_FIELD_OF_VIEW_ANGLE) / BIN_SIZE));
+        return std::min(std::max(bin, 0), numBins - 1);
+    };
+    for (size_t p = 0; p < count; ++p) {
+        if (z[p] <= 0) {
+            continue;
+        }
+        float &nearest = nearestHit[binOf(std::atan2(x[p], z[p]) * 180 / PI)];
+        nearest = std::min(nearest, std::hypot(x[p], z[p]));
+    }
+
+    //Cells in view before the nearest point were seen to be empty
+    for (int row = 0; row < SIZE; ++row) {
+        for (int column = 0; column < SIZE; ++column) {
+            float cx, cz;
+            toRover(left + column, bottom + row, cx, cz);
+            float range = std::hypot(cx, cz);
+            float &cell = logOdds[index(left + column, bottom + row)];
+
+            //Cells too close to see fade out, an obstacle the rover turned next to doesn't block it for good
+            if (range < MIN_RANGE) {
+                cell = cell > 0 ? std::max(cell - UNSEEN_DECAY, 0.0f) : std::min(cell + UNSEEN_DECAY, 0.0f);
+                continue;
+            }
+            if (cz <= 0) {
+                continue;
+            }
+            double angle = std::atan2(cx, cz) * 180 / PI;
+            if (std::fabs(angle) > MAX_FIELD_OF_VIEW_ANGLE || range >= nearestHit[binOf(angle)] - CELL_SIZE) {
+                continue;
+            }
+            cell = std::max(cell - MISS, MIN_LOG_ODDS);
+        }
+    }
+
+    //Every cell a point falls in counts once however many points it holds
+    for (size_t p = 0; p < count; ++p) {
+        double pointEast = east + x[p] * cosHeading + z[p] * sinHeading;
+        double pointNorth = north - x[p] * sinHeading + z[p] * cosHeading;
+        int i = static_cast<int>(std::floor(pointEast / CELL_SIZE));
+        int j = static_cast<int>(std::floor(pointNorth / CELL_SIZE));
+        if (i < left || i >= left + SIZE || j < bottom || j >= bottom + SIZE) {
+            continue;
+        }
+        int cell = index(i, j);
+        if (lastHit[cell] != frame) {
+            lastHit[cell] = frame;
+            logOdds[cell] = std::min(logOdds[cell] + HIT, MAX_LOG_ODDS);
+        }
+    }
+}
+
+obstacle_return OccupancyGrid::findClearPath() {
+    occupiedX.clear();
+    occupiedZ.clear();
+    float centerDistance = INFINITY;
+    for (int row = 0; row < SIZE; ++row) {
+        for (int column = 0; column < SIZE; ++column) {
+            if (logOdds[index(left + column, bottom + row)] <= OCCUPIED) {
+                continue;
+            }
+            float x, z;
+            toRover(left + column, bottom + row, x, z);
+            if (z <= 0) {
+                continue;
+            }
+            occupiedX.push_back(x);
+            occupiedZ.push_back(z);
+            if (std::fabs(x) <= HALF_ROVER) {
+                centerDistance = std::min(centerDistance, z);
+            }
+        }
+    }
+
+    //The bearings stay 0 and the distance -1 while the center path is clear
+    if (centerDistance == INFINITY) {
+        return obstacle_return(0, 0, -1);
+    }
+    clearPath.clear();
+    clearPath.addPoints(occupiedX.data(), occupiedZ.data(), occupiedX.size());
+    return obstacle_return(clearPath.findBearing(0), clearPath.findBearing(1), centerDistance / MM_PER_M);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "perception.hpp"
+#include "polar_clear_path.hpp"
+
+/* --- Occupancy Grid --- */
+/**
+\brief Log-odds occupancy of the ground around the rover, kept across frames
+Cells are aligned east and north and the grid scrolls with the rover, storage
+wraps around so moving only clears the rows and columns that come into view.
+Every frame the cells an obstacle point lands in gain HIT and the cells the
+camera saw past, nearer than the closest point at their bearing, lose MISS.
+Cells closer than MIN_RANGE are below the camera's view and fade towards
+unknown by UNSEEN_DECAY every frame instead. Clear paths are found from the occupied cells, so an obstacle has to be
+seen in a few frames before it shows up and a missed frame doesn't drop it
+*/
+class OccupancyGrid {
+public:
+    //Constants, lengths are in mm and angles in degrees
+    int SIZE;
+    float CELL_SIZE;
+    float HIT;
+    float MISS;
+    float MIN_LOG_ODDS;
+    float MAX_LOG_ODDS;
+    float OCCUPIED;
+    float MIN_RANGE;
+    float UNSEEN_DECAY;
+    float MAX_RANGE;
+    double MAX_FIELD_OF_VIEW_ANGLE;
+    double BIN_SIZE;
+    float HALF_ROVER;
+    double MM_PER_M;
+
+    //Reads occupancy_grid, and the field of view, rover width and range from pt_cloud
+    OccupancyGrid(const rapidjson::Document &config);
+
+    //Moves the rover to east and north mm from any fixed origin, heading clockwise from north
+    void setPose(double east, double north, double heading);
+
+    //Adds a frame of obstacle points, x to the right and z forward of the camera
+    void update(const float *x, const float *z, size_t count);
+
+    //Clear path bearings and the distance to the nearest occupied cell in the center path, like PCL
+    obstacle_return findClearPath();
+
+    //Occupied cells in front of the rover as of the last findClearPath
+    size_t occupiedCells() const { return occupiedX.size(); }
+
+    //Forgets everything
+    void clear();
+
+private:
+    //Storage index of the cell at world column i and row j
+    int index(int i, int j) const;
+
+    //Scrolls the window so it is centered on world cell (i, j)
+    void scrollTo(int i, int j);
+
+    //Rover frame offset of the center of world cell (i, j)
+    void toRover(int i, int j, float &x, float &z) const;
+
+    std::vector<float> logOdds;
+    std::vector<int> lastHit;
+    int frame;
+
+    //World cell in the lower left corner of the window
+    int left;
+    int bottom;
+    bool placed;
+
+    double east;
+    double north;
+    double sinHeading;
+    double cosHeading;
+
+    //Range of the nearest point in each bearing bin this frame, cells past it are hidden
+    std::vector<float> nearestHit;
+
+    PolarClearPath clearPath;
+    std::vector<float> occupiedX;
+    std::vector<float> occupiedZ;
+};
@@ -0,0 +1,134 @@
+#include "parallel_plane_ransac.hpp"
+#include "perception.hpp"
+#include <random>
+
+#if OBSTACLE_DETECTION
+
+ParallelPlaneRansac::ParallelPlaneRansac(double distanceThreshold, const Eigen::Vector3f &axis, double maxAngle,
+                                         int maxIterations, int numThreads, uint32_t seed) :
+    distanceThreshold{distanceThreshold}, axis{axis.normalized()}, maxAngle{maxAngle},
+    maxIterations{maxIterations}, seed{seed}, pool{std::max(numThreads, 1)} {}
+
+int ParallelPlaneRansac::countInliers(const Eigen::Vector4f &plane) const {
+    const float a = plane[0], b = plane[1], c = plane[2], d = plane[3];
+    const float threshold = static_cast<float>(distanceThreshold);
+    const float *x = xs.data(), *y = ys.data(), *z = zs.data();
+    const size_t numPoints = xs.size();
+
+    //Branch free so the compiler can vectorize it
+    int count = 0;
+    for (size_t i = 0; i < numPoints; ++i) {
+        count += std::abs(a * x[i] + b * y[i] + c * z[i] + d) <= threshold;
+    }
+    return count;
+}
+
+ParallelPlaneRansac::Hypothesis ParallelPlaneRansac::search(int thread, int first, int last) {
+    std::seed_seq sequence{seed, static_cast<uint32_t>(thread)};
+    std::mt19937 generator(sequence);
+    std::uniform_int_distribution<int> pick(0, static_cast<int>(xs.size()) - 1);
+    const float cosMaxAngle = static_cast<float>(std::cos(maxAngle));
+
+    Hypothesis result{-1, -1, Eigen::Vector4f::Zero()};
+    for (int h = first; h < last; ++h) {
+        //Every hypothesis draws its three samples, even the rejected ones, so the streams stay in step
+        int i0 = pick(generator), i1 = pick(generator), i2 = pick(generator);
+        if (i0 == i1 || i0 == i2 || i1 == i2) {
+            continue;
+        }
+
+        Eigen::Vector3f p0(xs[i0], ys[i0], zs[i0]);
+        Eigen::Vector3f p1(xs[i1], ys[i1], zs[i1]);
+        Eigen::Vector3f p2(xs[i2], ys[i2], zs[i2]);
+        Eigen::Vector3f normal = (p1 - p0).cross(p2 - p0);
+        float length = normal.norm();
+        if (length == 0) {
+            continue;
+        }
+        normal /= length;
+
+        //Same test as SACMODEL_PERPENDICULAR_PLANE, the normal may point either way along the axis
+        if (std::abs(normal.dot(axis)) < cosMaxAngle) {
+            continue;
+        }
+
+        Eigen::Vector4f plane(normal.x(), normal.y(), normal.z(), -normal.dot(p0));
+        int inliers = countInliers(plane);
+        if (inliers > result.inliers) {
+            result = Hypothesis{inliers, h, plane};
+        }
+    }
+    return result;
+}
+
+void ParallelPlaneRansac::segment(const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+                                  pcl::PointIndices &inliers, pcl::ModelCoefficients &coefficients) {
+    inliers.indices.clear();
+    coefficients.values.clear();
+
+    const auto &points = cloud.points;
+    if (points.size() < 3) {
+        return;
+    }
+    xs.resize(points.size());
+    ys.resize(points.size());
+    zs.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        xs[i] = points[i].x;
+        ys[i] = points[i].y;
+        zs[i] = points[i].z;
+    }
+
+    //Each thread gets a fixed contiguous block of hypotheses
+    const int numThreads = pool.size();
+    best.resize(numThreads);
+    pool.run([&](int thread) {
+        int first = static_cast<int>(static_cast<int64_t>(maxIterations) * thread / numThreads);
+        int last = static_cast<int>(static_cast<int64_t>(maxIterations) * (thread + 1) / numThreads);
+        best[thread] = search(thread, first, last);
+    });
+
+    //Blocks are in hypothesis order, so keeping the first maximum breaks ties by lowest index
+    Hypothesis winner = best[0];
+    for (int t = 1; t < numThreads; ++t) {
+        if (best[t].inliers > winner.inliers) {
+            winner = best[t];
+        }
+    }
+    if (winner.inliers < 3) {
+        return;
+    }
+
+    //Refit the plane to its inliers: through their centroid, normal along the direction of least variance
+    const float threshold = static_cast<float>(distanceThreshold);
+    Eigen::Vector3d sum = Eigen::Vector3d::Zero();
+    Eigen::Matrix3d products = Eigen::Matrix3d::Zero();
+    int count = 0;
+    for (size_t i = 0; i < xs.size(); ++i) {
+        if (std::abs(winner.plane[0] * xs[i] + winner.plane[1] * ys[i] + winner.plane[2] * zs[i] + winner.plane[3]) <= threshold) {
+            Eigen::Vector3d p(xs[i], ys[i], zs[i]);
+            sum += p;
+            products += p * p.transpose();
+            ++count;
+        }
+    }
+    Eigen::Vector3d centroid = sum / count;
+    Eigen::Matrix3d covariance = products / count - centroid * centroid.transpose();
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+    Eigen::Vector3f normal = solver.eigenvectors().col(0).cast<float>();
+    if (normal.dot(winner.plane.head<3>()) < 0) {
+        normal = -normal;
+    }
+    Eigen::Vector4f plane(normal.x(), normal.y(), normal.z(), -normal.dot(centroid.cast<float>()));
+
+    //Inliers are taken from the refit plane, as pcl does after optimizing coefficients
+    inliers.indices.reserve(count);
+    for (size_t i = 0; i < xs.size(); ++i) {
+        if (std::abs(plane[0] * xs[i] + plane[1] * ys[i] + plane[2] * zs[i] + plane[3]) <= threshold) {
+            inliers.indices.push_back(static_cast<int>(i));
+        }
+    }
+    coefficients.values.assign({plane[0], plane[1], plane[2], plane[3]});
+}
+
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "config.h"
+#include "thread_pool.hpp"
+
+#if OBSTACLE_DETECTION
+#include <pcl/point_types.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+
+/* --- Parallel Plane RANSAC --- */
+/**
+\brief RANSAC for a plane whose normal lies within maxAngle of axis,
+the same model as pcl::SACMODEL_PERPENDICULAR_PLANE
+The hypotheses are split evenly across a thread pool and each thread draws
+its samples from its own generator seeded from seed and the thread index,
+so the same seed and thread count always give the same plane. The best
+hypothesis has the most inliers, ties going to the lowest hypothesis
+index, and is refit to its inliers by least squares like
+setOptimizeCoefficients(true) does
+*/
+class ParallelPlaneRansac {
+public:
+    ParallelPlaneRansac(double distanceThreshold, const Eigen::Vector3f &axis, double maxAngle,
+                        int maxIterations, int numThreads, uint32_t seed);
+
+    //Leaves inliers and coefficients empty if no plane was found
+    void segment(const pcl::PointCloud<pcl::PointXYZRGB> &cloud,
+                 pcl::PointIndices &inliers, pcl::ModelCoefficients &coefficients);
+
+private:
+    //Plane a thread found and the hypothesis it came from
+    struct Hypothesis {
+        int inliers;
+        int index;
+        Eigen::Vector4f plane;
+    };
+
+    //Tests hypotheses [first, last) using the generator of the given thread
+    Hypothesis search(int thread, int first, int last);
+
+    //Number of points within distanceThreshold of plane
+    int countInliers(const Eigen::Vector4f &plane) const;
+
+    double distanceThreshold;
+    Eigen::Vector3f axis;
+    double maxAngle;
+    int maxIterations;
+    uint32_t seed;
+    ThreadPool pool;
+
+    //Point coordinates as flat arrays so inlier counting streams through memory
+    std::vector<float> xs;
+    std::vector<float> ys;
+    std::vector<float> zs;
+    std::vector<Hypothesis> best;
+};
+
+#endif
@@ -1,10 +1,15 @@
 #include "pcl.hpp"
 #include "perception.hpp"
+#include <cmath>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 #if OBSTACLE_DETECTION
 
     //Constructor
-    PCL::PCL(const rapidjson::Document &mRoverConfig) : 
+    template <typename Sink>
+    PCL<Sink>::PCL(const rapidjson::Document &mRoverConfig) : 
 
         //Populate Constants from Config File
         MAX_FIELD_OF_VIEW_ANGLE{mRoverConfig["pt_cloud"]["max_field_of_view_angle"].GetInt()},
@@ -25,12 +30,27 @@
         
         //Other Values
         leftBearing{0}, rightBearing{0}, distance{0}, detected{false},
-        pt_cloud_ptr{new pcl::PointCloud<pcl::PointXYZRGB>} {
-
-        #if PERCEPTION_DEBUG
-        viewer = createRGBVisualizer(); //This is a smart pointer so no need to worry ab deleteing it
-        viewer_original = createRGBVisualizer();
-        #endif
+        pt_cloud_ptr{new pcl::PointCloud<pcl::PointXYZRGB>},
+        filtered_cloud_ptr{new pcl::PointCloud<pcl::PointXYZRGB>},
+        clusterer{static_cast<float>(CLUSTER_TOLERANCE), MIN_CLUSTER_SIZE, MAX_CLUSTER_SIZE},
+        arena{static_cast<size_t>(mRoverConfig["pt_cloud"]["frame_arena_bytes"].GetInt())},
+        clearPath{static_cast<double>(MAX_FIELD_OF_VIEW_ANGLE), mRoverConfig["pt_cloud"]["clear_path"]["bin_size"].GetDouble(),
+                  static_cast<double>(HALF_ROVER + mRoverConfig["pt_cloud"]["clear_path"]["buffer"].GetInt())},
+        ground_coefficients{new pcl::ModelCoefficients},
+        ground_inliers{new pcl::PointIndices},
+        planeTracker{DISTANCE_THRESHOLD, pcl::deg2rad(SEGMENTATION_EPSLION),
+                     mRoverConfig["pt_cloud"]["ransac"]["track_min_inlier_ratio"].GetDouble(),
+                     mRoverConfig["pt_cloud"]["ransac"]["track_max_frames"].GetInt(), MAX_ITERATIONS},
+        //Looks for a plane with its normal within SEGMENTATION_EPSLION degrees of the y axis,
+        //points up to DISTANCE_THRESHOLD mm away from it are inliers
+        groundRansac{DISTANCE_THRESHOLD, Eigen::Vector3f(0, 1, 0), pcl::deg2rad(SEGMENTATION_EPSLION), MAX_ITERATIONS,
+                     mRoverConfig["pt_cloud"]["ransac"]["threads"].GetInt(),
+                     mRoverConfig["pt_cloud"]["ransac"]["seed"].GetUint()} {
+
+        if (Sink::ENABLED) {
+            viewer = createRGBVisualizer(); //This is a smart pointer so no need to worry ab deleteing it
+            viewer_original = createRGBVisualizer();
+        }
 
         #if ZED_SDK_PRESENT
            sl::Resolution cloud_res = sl::Resolution(PT_CLOUD_WIDTH, PT_CLOUD_HEIGHT);
@@ -39,40 +59,84 @@
             cloudArea = PT_CLOUD_WIDTH*PT_CLOUD_HEIGHT;
         #endif
 
+        //Reserve the fused filter buffers up front so the per frame sweep never allocates
+        filtered_cloud_ptr->points.reserve(cloudArea);
+        voxel_entries.reserve(cloudArea);
     };
 
-/* --- Pass Through Filter --- */
-//Filters out all points on a given axis passed as a string ("x", "y", or "z") that aren't within the threshold
-//The threshold covers points from 0.0 to upperLimit
-//Values are depth values in mm
-//Source: https://rb.gy/kkyi80
-void PCL::PassThroughFilter(const std::string axis, const double upperLimit) {
-    #if PERCEPTION_DEBUG
-        pcl::ScopeTime t("PassThroughFilter");
-    #endif
-
-    pcl::PassThrough<pcl::PointXYZRGB> pass;
-    pass.setInputCloud(pt_cloud_ptr);
-
-    pass.setFilterFieldName(axis);
-    pass.setFilterLimits( LOW_BD, upperLimit);
-    pass.filter(*pt_cloud_ptr);
-}
+/* --- Fused Pass Through and Voxel Filter --- */
+//Pass through filters z and y and downsamples with a voxel grid
+//in a single sweep over the organized cloud
+//Points outside of [LOW_BD, UP_BD_Z] on z or [LOW_BD, UP_BD_Y] on y are skipped,
+//every other point is tagged with the voxel it falls in
+//The tags are sorted so each voxel is contiguous and reduced to its centroid
+//straight into filtered_cloud_ptr, which is then swapped with pt_cloud_ptr
+template <typename Sink>
+void PCL<Sink>::PassThroughVoxelFilter() {
+    typename Sink::Scope t("PassThroughVoxelFilter");
+    StageTimer passThroughTimer(stageTimes[STAGE_PASS_THROUGH]);
+
+    //Offset keeps voxel coordinates positive so they can be packed in 21 bits each
+    const int64_t VOXEL_OFFSET = 1 << 20;
+    const float inverseLeaf = 1.0f / LEAF_SIZE;
+
+    voxel_entries.clear();
+    const auto &points = pt_cloud_ptr->points;
+    for (int i = 0; i < (int)points.size(); ++i) {
+        const pcl::PointXYZRGB &pt = points[i];
+
+        //Same inclusive bounds as pcl::PassThrough, NaN fails both comparisons
+        if (!(pt.z >= LOW_BD && pt.z <= UP_BD_Z) || !(pt.y >= LOW_BD && pt.y <= UP_BD_Y) || !std::isfinite(pt.x)) {
+            continue;
+        }
+
+        uint64_t ix = static_cast<uint64_t>(static_cast<int64_t>(std::floor(pt.x * inverseLeaf)) + VOXEL_OFFSET);
+        uint64_t iy = static_cast<uint64_t>(static_cast<int64_t>(std::floor(pt.y * inverseLeaf)) + VOXEL_OFFSET);
+        uint64_t iz = static_cast<uint64_t>(static_cast<int64_t>(std::floor(pt.z * inverseLeaf)) + VOXEL_OFFSET);
+        voxel_entries.push_back({(iz << 42) | (iy << 21) | ix, i});
+    }
+    passThroughTimer.stop();
+
+    StageTimer voxelTimer(stageTimes[STAGE_VOXEL]);
+
+    std::sort(voxel_entries.begin(), voxel_entries.end(), [](const VoxelEntry &a, const VoxelEntry &b) {
+        return a.key < b.key;
+    });
+
+    //Reduce every run of equal keys to the centroid of its points
+    filtered_cloud_ptr->points.clear();
+    size_t first = 0;
+    while (first < voxel_entries.size()) {
+        size_t last = first;
+        float x = 0, y = 0, z = 0;
+        uint32_t r = 0, g = 0, b = 0;
+        while (last < voxel_entries.size() && voxel_entries[last].key == voxel_entries[first].key) {
+            const pcl::PointXYZRGB &pt = points[voxel_entries[last].index];
+            x += pt.x;
+            y += pt.y;
+            z += pt.z;
+            r += pt.r;
+            g += pt.g;
+            b += pt.b;
+            ++last;
+        }
 
-/* --- Voxel Filter --- */
-//Creates clusters given by the size of a leaf
-//All points in a cluster are then reduced to a single point
-//This point is the centroid of the cluster
-//Source: https://rb.gy/2ybg8n
-void PCL::DownsampleVoxelFilter() {
-    #if PERCEPTION_DEBUG
-        pcl::ScopeTime t("VoxelFilter");
-    #endif
-
-    pcl::VoxelGrid<pcl::PointXYZRGB> sor;
-    sor.setInputCloud (pt_cloud_ptr);
-    sor.setLeafSize(LEAF_SIZE, LEAF_SIZE, LEAF_SIZE);
-    sor.filter (*pt_cloud_ptr);
+        const float count = static_cast<float>(last - first);
+        pcl::PointXYZRGB centroid;
+        centroid.x = x / count;
+        centroid.y = y / count;
+        centroid.z = z / count;
+        centroid.r = static_cast<uint8_t>(r / (last - first));
+        centroid.g = static_cast<uint8_t>(g / (last - first));
+        centroid.b = static_cast<uint8_t>(b / (last - first));
+        filtered_cloud_ptr->points.push_back(centroid);
+        first = last;
+    }
+
+    filtered_cloud_ptr->width = filtered_cloud_ptr->points.size();
+    filtered_cloud_ptr->height = 1;
+    filtered_cloud_ptr->is_dense = true;
+    pt_cloud_ptr.swap(filtered_cloud_ptr);
 }
 
 /* --- RANSAC Plane Segmentation Blue --- */
@@ -83,96 +147,93 @@ void PCL::DownsampleVoxelFilter() {
 //Colors all points in this plane blue or
 //removes points completely from point cloud
 //Source: https://rb.gy/zx6ojh
-void PCL::RANSACSegmentation(string type) {
-    #if PERCEPTION_DEBUG
-        pcl::ScopeTime t("RANSACSegmentation");
-    #endif
-
-    //Creates instance of RANSAC Algorithm
-    pcl::SACSegmentation<pcl::PointXYZRGB> seg;
-    seg.setOptimizeCoefficients(true);
-    seg.setModelType(pcl::SACMODEL_PERPENDICULAR_PLANE);
-    seg.setMethodType(pcl::SAC_RANSAC);
-    seg.setMaxIterations(MAX_ITERATIONS);
-    seg.setDistanceThreshold(DISTANCE_THRESHOLD); //Distance in mm away from actual plane a point can be
-    // to be considered an inlier
-    seg.setAxis(Eigen::Vector3f(0, 1, 0)); //Looks for a plane along the Z axis
-    //Max degree the normal of plane can be from Z axis
-    seg.setEpsAngle(pcl::deg2rad(SEGMENTATION_EPSLION));
-
-    //Objects where segmented plane is stored
-    pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients());
-    pcl::PointIndices::Ptr inliers(new pcl::PointIndices());
-
-    seg.setInputCloud(pt_cloud_ptr);
-    seg.segment(*inliers, *coefficients);
+template <typename Sink>
+void PCL<Sink>::RANSACSegmentation(string type) {
+    typename Sink::Scope t("RANSACSegmentation");
+    StageTimer timer(stageTimes[STAGE_RANSAC]);
+
+    //Objects where segmented plane is stored, reused between frames
+    ground_coefficients->values.clear();
+    ground_inliers->indices.clear();
+
+    //Only search for a new plane if last frame's no longer fits
+    if (!planeTracker.track(*pt_cloud_ptr, *ground_coefficients, *ground_inliers)) {
+        //Hypotheses are scored across the RANSAC thread pool
+        groundRansac.segment(*pt_cloud_ptr, *ground_inliers, *ground_coefficients);
+        planeTracker.reset(*ground_coefficients, *ground_inliers, pt_cloud_ptr->points.size());
+    }
+
+    if (Sink::ENABLED) {
+        const GroundPlaneTracker::Stats &stats = planeTracker.stats();
+        std::cout << "Ground plane " << (stats.lastFrameTracked ? "tracked" : "refreshed")
+                  << ", inlier ratio " << stats.lastInlierRatio
+                  << ", iterations saved " << stats.lastIterationsSaved
+                  << " (" << stats.iterationsSaved << " total over " << stats.framesTracked << " frames)" << std::endl;
+    }
 
     if(type == "blue") {
-        for (int i = 0; i < (int)inliers->indices.size(); i++) {
-            pt_cloud_ptr->points[inliers->indices[i]].r = 255;
-            pt_cloud_ptr->points[inliers->indices[i]].g = 255;
-            pt_cloud_ptr->points[inliers->indices[i]].b = 0;
+        for (int i = 0; i < (int)ground_inliers->indices.size(); i++) {
+            pt_cloud_ptr->points[ground_inliers->indices[i]].r = 255;
+            pt_cloud_ptr->points[ground_inliers->indices[i]].g = 255;
+            pt_cloud_ptr->points[ground_inliers->indices[i]].b = 0;
         }
     }
     else {
-        //Creates object that filters out identified points
-        pcl::ExtractIndices<pcl::PointXYZRGB> extract;
-        extract.setInputCloud(pt_cloud_ptr);
-        extract.setIndices(inliers);
-        extract.setNegative(true); //Controls whether chosen indices are retained or removed
-        extract.filter(*pt_cloud_ptr);
+        //Filters out identified points in place instead of copying the cloud
+        //Inliers are marked first since they are not guaranteed to be sorted
+        auto &points = pt_cloud_ptr->points;
+        ArenaVector<char> isInlier(points.size(), 0, ArenaAllocator<char>(arena));
+        for (int index : ground_inliers->indices) {
+            isInlier[index] = 1;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < points.size(); ++i) {
+            if (!isInlier[i]) {
+                points[kept++] = points[i];
+            }
+        }
+        points.resize(kept);
+        pt_cloud_ptr->width = kept;
+        pt_cloud_ptr->height = 1;
     }
 }
 
 /* --- Euclidian Cluster Extraction --- */
-//Creates a KdTree structure from point cloud
-//Use this tree to traverse point cloud and create vector of clusters
-//Return vector of clusters
+//Hashes the point cloud into a grid with cells the size of the cluster tolerance
+//Points within the tolerance of each other in neighboring cells are merged
+//Return vector of clusters, the same ones pcl::EuclideanClusterExtraction gives
+//without building a KdTree every frame
 //Source: https://rb.gy/qvjati
-void PCL::CPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_indices) {
-    #if PERCEPTION_DEBUG
-        pcl::ScopeTime t("CPU Cluster Extraction");
-    #endif
-
-    // Creating the KdTree object for the search method of the extraction
-    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
-    tree->setInputCloud(pt_cloud_ptr);
-
-    //Extracts clusters using nearet neighbors search
-    pcl::EuclideanClusterExtraction<pcl::PointXYZRGB> ec;
-    ec.setClusterTolerance (CLUSTER_TOLERANCE); // 60 mm radius per point
-    ec.setMinClusterSize (MIN_CLUSTER_SIZE);
-    ec.setMaxClusterSize (MAX_CLUSTER_SIZE);
-    ec.setSearchMethod (tree);
-    ec.setInputCloud (pt_cloud_ptr);
-    ec.extract (cluster_indices);
+template <typename Sink>
+void PCL<Sink>::CPUEuclidianClusterExtraction(ClusterIndices &cluster_indices) {
+    typename Sink::Scope t("CPU Cluster Extraction");
+    StageTimer timer(stageTimes[STAGE_CLUSTERING]);
+
+    //Extracts clusters with a 60 mm radius per point
+    clusterer.extract(*pt_cloud_ptr, cluster_indices);
 
     //Colors all clusters
-    #if PERCEPTION_DEBUG
+    if (Sink::ENABLED) {
         std::cout << "Number of clusters: " << cluster_indices.size() << std::endl;
         int j = 0;
 
-        for(std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin(); it != cluster_indices.end(); ++it) {
-            for(std::vector<int>::const_iterator pit = it->indices.begin(); pit != it->indices.end(); ++pit) {
+        for(size_t cluster = 0; cluster < cluster_indices.size(); ++cluster) {
+            for(const int *pit = cluster_indices.begin(cluster); pit != cluster_indices.end(cluster); ++pit) {
+                uint8_t shade = 100 + j * 15;
                 if(j % 3) {
-                    pt_cloud_ptr->points[*pit].r = 100 + j * 15;
-                    pt_cloud_ptr->points[*pit].g = 0;
-                    pt_cloud_ptr->points[*pit].b = 0;
+                    Sink::color(pt_cloud_ptr->points[*pit], shade, 0, 0);
                 }
                 else if(j % 2) {
-                    pt_cloud_ptr->points[*pit].r = 0;
-                    pt_cloud_ptr->points[*pit].g = 100 + j * 15;
-                    pt_cloud_ptr->points[*pit].b = 0;
+                    Sink::color(pt_cloud_ptr->points[*pit], 0, shade, 0);
                 }
                 else {
-                    pt_cloud_ptr->points[*pit].r = 0;
-                    pt_cloud_ptr->points[*pit].g = 0;
-                    pt_cloud_ptr->points[*pit].b = 100 + j * 15;
+                    Sink::color(pt_cloud_ptr->points[*pit], 0, 0, shade);
                 }
             }
             j++;
         }
-    #endif
+    }
 }
 
 /* --- Find Interest Points --- */
@@ -180,141 +241,120 @@ void PCL::CPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_
 //values of all points in the cluster to find desired ones
 //Interest points are a collection of points that allow us
 //to define the edges of an obsacle
-void PCL::FindInterestPoints(std::vector<pcl::PointIndices> &cluster_indices,
-                             std::vector<std::vector<int>> &interest_points) {
+template <typename Sink>
+void PCL<Sink>::FindInterestPoints(const ClusterIndices &cluster_indices, InterestPoints &interest_points) {
+
+    typename Sink::Scope t("Find Interest Points");
+    StageTimer timer(stageTimes[STAGE_INTEREST_POINTS]);
 
-    #if PERCEPTION_DEBUG
-        pcl::ScopeTime t("Find Interest Points");
-    #endif
+    const auto &points = pt_cloud_ptr->points;
+    ClusterIndices &interest_indices = interest_points.index;
+    interest_indices.offsets.reserve(cluster_indices.size() + 1);
 
-    for (int i = 0; i < (int)cluster_indices.size(); ++i)
+    for (size_t i = 0; i < cluster_indices.size(); ++i)
     {
-        std::vector<int>* curr_cluster = &interest_points[i];
-        
+        //Interest Points: 0=Leftmost Point 1=Rightmost Point 2=Lowest Point 3=Highest Point 4=Closest Point 5=Furthest Point.
+        int curr_cluster[6];
+
         //Initialize interest points
-        std::fill(curr_cluster->begin(), curr_cluster->end(), cluster_indices[i].indices[0]);
+        std::fill(curr_cluster, curr_cluster + 6, *cluster_indices.begin(i));
 
-        //Interest Points: 0=Leftmost Point 1=Rightmost Point 2=Lowest Point 3=Highest Point 4=Closest Point 5=Furthest Point.
-        for (auto index : cluster_indices[i].indices)
+        for (const int *it = cluster_indices.begin(i); it != cluster_indices.end(i); ++it)
         {
-            auto curr_point = pt_cloud_ptr->points[index];
-            
-            if(curr_point.x < pt_cloud_ptr->points[curr_cluster->at(0)].x){
-                curr_cluster->at(0) = index;
+            int index = *it;
+            const pcl::PointXYZRGB &curr_point = points[index];
+
+            if(curr_point.x < points[curr_cluster[0]].x){
+                curr_cluster[0] = index;
             }
-            if(curr_point.x > pt_cloud_ptr->points[curr_cluster->at(1)].x){
-                curr_cluster->at(1) = index;
+            if(curr_point.x > points[curr_cluster[1]].x){
+                curr_cluster[1] = index;
             }
-            if(curr_point.y < pt_cloud_ptr->points[curr_cluster->at(2)].y){
-                curr_cluster->at(2) = index;
+            if(curr_point.y < points[curr_cluster[2]].y){
+                curr_cluster[2] = index;
             }
-            if(curr_point.y > pt_cloud_ptr->points[curr_cluster->at(3)].y){
-                curr_cluster->at(3) = index;
+            if(curr_point.y > points[curr_cluster[3]].y){
+                curr_cluster[3] = index;
             }
-            if(curr_point.z < pt_cloud_ptr->points[curr_cluster->at(4)].z){
-                curr_cluster->at(4) = index;
+            if(curr_point.z < points[curr_cluster[4]].z){
+                curr_cluster[4] = index;
             }
-            if(curr_point.z > pt_cloud_ptr->points[curr_cluster->at(5)].z){
-                curr_cluster->at(5) = index;
+            if(curr_point.z > points[curr_cluster[5]].z){
+                curr_cluster[5] = index;
             }
         }
 
+        size_t base = interest_indices.indices.size();
+        interest_indices.indices.insert(interest_indices.indices.end(), curr_cluster, curr_cluster + 6);
+
         //Calulates the width of the obstacle based on the difference between the leftmost and rightmost interest point.
-        double width = std::abs(pt_cloud_ptr->points[curr_cluster->at(1)].x - pt_cloud_ptr->points[curr_cluster->at(0)].x);
+        double width = std::abs(points[curr_cluster[1]].x - points[curr_cluster[0]].x);
         //Calculates the number of rover widths that fit within the obstacle. The x10 multiplier adds more width increments.
         int roverWidths = ((int) width/ROVER_W_MM) * 10;
 
         //Only want to add interest points if the obstacle's width > rover's Width.
         if(roverWidths > 0) {
-            //Create a map data structure where the Key is an int from 0  to roverWidths-1.
-            //Each key index represents the a percentile increment.
+            //Each index represents the a percentile increment.
             //Example: if roverWidths = 40, then index 0 would represent leftmost + 0.025 * obstacle width,
             //index 1 would represent leftmost + 0.05 * obstacle width and so on.
-            std::map<int, double> increments;
-            for(size_t i = 0; i < (size_t) roverWidths; ++i) {
-                //The defualt value stored in each key is the value of the leftmost interest point.
-                increments[i] = pt_cloud_ptr->points[curr_cluster->at(0)].x;
-                //Creates a new interest point and sets it equal to the index of the leftmost point.
-                curr_cluster->push_back(curr_cluster->at(0));
-            }
-            
-            //Using the x value of the current point, calculate the percentile that the current point would fall under, 
+            //The defualt value stored in each index is the value of the leftmost interest point.
+            ArenaVector<double> increments(roverWidths, points[curr_cluster[0]].x, ArenaAllocator<double>(arena));
+            //Creates the new interest points and sets them equal to the index of the leftmost point.
+            interest_indices.indices.resize(base + 6 + roverWidths, curr_cluster[0]);
+
+            //Using the x value of the current point, calculate the percentile that the current point would fall under,
             //and then compare that x value to the one of the point that is currently representing that percentile.
-            for (auto index : cluster_indices[i].indices) {
-                auto curr_point = pt_cloud_ptr->points[index];
-                if(curr_point.x > pt_cloud_ptr->points[curr_cluster->at(0)].x && curr_point.x < pt_cloud_ptr->points[curr_cluster->at(1)].x) {
+            for (const int *it = cluster_indices.begin(i); it != cluster_indices.end(i); ++it) {
+                int index = *it;
+                const pcl::PointXYZRGB &curr_point = points[index];
+                if(curr_point.x > points[curr_cluster[0]].x && curr_point.x < points[curr_cluster[1]].x) {
                     //If roverWidths = 40 and if your x value falls between leftmost + 0.025 * obstacle width and leftmost + 0.05 * obstacle width,
                     //then the value of i would be 1 which represents the index of increment map the we want to check.
-                    int j = ((double)(std::abs(curr_point.x - pt_cloud_ptr->points[curr_cluster->at(0)].x)/width)/((double) 1/roverWidths));
-                    //If the x value of the current point is greater than the value representing that percentile, 
+                    int j = ((double)(std::abs(curr_point.x - points[curr_cluster[0]].x)/width)/((double) 1/roverWidths));
+                    j = std::min(j, roverWidths - 1);
+                    //If the x value of the current point is greater than the value representing that percentile,
                     //we set the value represnting the percentile equal to the x value of the current point.
                     if(increments[j] < curr_point.x) {
                         increments[j] = curr_point.x;
-                        curr_cluster->at(6 + j) = index;
+                        interest_indices.indices[base + 6 + j] = index;
                     }
                 }
             }
         }
-        
-        #if PERCEPTION_DEBUG
-            for(auto interest_point : *curr_cluster)
+        interest_indices.endGroup();
+
+        if (Sink::ENABLED) {
+            for(const int *interest_point = interest_indices.begin(i); interest_point != interest_indices.end(i); ++interest_point)
             {
-                pt_cloud_ptr->points[interest_point].r = 255;
-                pt_cloud_ptr->points[interest_point].g = 255;
-                pt_cloud_ptr->points[interest_point].b = 255;
+                Sink::color(pt_cloud_ptr->points[*interest_point], 255, 255, 255);
             }
-        #endif
+        }
     }
-}
 
-/* --- Get Angle Off Center--- */
-//This function finds the angle off center the
-//line that passes through both these points is
-//Direction of 0 is left and 1 is right
-double PCL::getAngleOffCenter(int buffer, int direction, const std::vector<std::vector<int>> &interest_points,
-                              std::vector<int> &obstacles) {
-    double newAngle = 0;
-    //If Center Path is blocked check the left or right path depending on direction parameter
-    while (newAngle > -MAX_FIELD_OF_VIEW_ANGLE && newAngle < MAX_FIELD_OF_VIEW_ANGLE) {
-
-        //Finding angle off center
-        double oppSideRTri = pt_cloud_ptr->points[obstacles.at(direction)].x;
-        double adjSideRTri = pt_cloud_ptr->points[obstacles.at(0)].z;            //Length of adjacent side of right triangle
-        oppSideRTri += direction ? buffer + HALF_ROVER : -(buffer + HALF_ROVER); //Calculate length of opposite side of right triangle
-        newAngle = atan(oppSideRTri / adjSideRTri) * 180 / PI;                   //arctan(opposite/adjacent)
-
-        //Create compareLine Functors
-        compareLine leftLine(newAngle, -HALF_ROVER);
-        compareLine rightLine(newAngle, HALF_ROVER);
-
-        obstacles.clear();
-
-        if(CheckPath(interest_points, obstacles, leftLine, rightLine)) {
-            #if PERCEPTION_DEBUG
-                std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!FOUND NEW PATH AT: " << newAngle << std::endl;
-            #endif
-            return newAngle;
-        }
+    //Gather the coordinates the path checks need into flat arrays
+    size_t numInterestPoints = interest_indices.indices.size();
+    interest_points.x.resize(numInterestPoints);
+    interest_points.z.resize(numInterestPoints);
+    for (size_t i = 0; i < numInterestPoints; ++i) {
+        interest_points.x[i] = points[interest_indices.indices[i]].x;
+        interest_points.z[i] = points[interest_indices.indices[i]].z;
     }
-    return direction ? MAX_FIELD_OF_VIEW_ANGLE : -MAX_FIELD_OF_VIEW_ANGLE; //If couldn't find clear path
 }
 
 /* --- Find Clear Path --- */
 // Calculates left and right bearings
-void PCL::FindClearPath(const std::vector<std::vector<int>> &interest_points) {
-    #if PERCEPTION_DEBUG
-        pcl::ScopeTime t("Find Clear Path");
-    #endif
-
-    std::vector<int> obstacles; //index of the leftmost and rightmost obstacles in path
+template <typename Sink>
+void PCL<Sink>::FindClearPath(const InterestPoints &interest_points) {
+    typename Sink::Scope t("Find Clear Path");
+    StageTimer timer(stageTimes[STAGE_CLEAR_PATH]);
 
     //Check Center Path
-    if(CheckPath(interest_points, obstacles, compareLine(0,-HALF_ROVER), compareLine(0,HALF_ROVER))) {
+    if(CheckPath(interest_points, compareLine(0,-HALF_ROVER), compareLine(0,HALF_ROVER))) {
       leftBearing = 0; // When no obstacles detected, reset bearings
       rightBearing = 0;
-      #if PERCEPTION_DEBUG
+      if (Sink::ENABLED) {
             std::cout << "CENTER PATH IS CLEAR!!!" << std::endl;
-      #endif
+      }
     }
     
     else {
@@ -322,22 +362,24 @@ void PCL::FindClearPath(const std::vector<std::vector<int>> &interest_points) {
         //Values that store the distances of the last obstacle from a given CheckPath. Center value gets its distance from previous loop of CheckPath
         double centerDistance = distance, leftDistance, rightDistance;
 
-        //Initialize base cases outside of scope
-        vector<int> centerObstacles = {obstacles.at(0), obstacles.at(1)};
+        //Project every interest point into the histogram of blocked bearings once
+        clearPath.clear();
+        clearPath.addPoints(interest_points.x.data(), interest_points.z.data(), interest_points.x.size());
 
         //Find clear left path, set left bearing
-        leftBearing = getAngleOffCenter(10, 0, interest_points, obstacles);
-        leftDistance = distance; 
-
-        //Reset global variables
-        obstacles = {0, 0};
-        obstacles.at(0) = centerObstacles.at(0);
-        obstacles.at(1) = centerObstacles.at(1);
+        leftBearing = clearPath.findBearing(0);
+        CheckPath(interest_points, compareLine(leftBearing, -HALF_ROVER), compareLine(leftBearing, HALF_ROVER));
+        leftDistance = distance;
 
         //Find clear right path, set right bearing
-        rightBearing = getAngleOffCenter(10, 1, interest_points, obstacles);
+        rightBearing = clearPath.findBearing(1);
+        CheckPath(interest_points, compareLine(rightBearing, -HALF_ROVER), compareLine(rightBearing, HALF_ROVER));
         rightDistance = distance;
 
+        if (Sink::ENABLED) {
+            std::cout << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!FOUND NEW PATHS AT: " << leftBearing << ", " << rightBearing << std::endl;
+        }
+
         //return smallest distance of an obstacle from all the paths
         if(rightDistance < leftDistance && rightDistance < centerDistance) distance = rightDistance/1000.0;
         else if(leftDistance < rightDistance && leftDistance < centerDistance) distance = leftDistance/1000.0;
@@ -350,55 +392,89 @@ void PCL::FindClearPath(const std::vector<std::vector<int>> &interest_points) {
 //If it is obstructed returns false
 //The path is constructed using the left x value and right x value of
 //the furthest points on the path
-bool PCL::CheckPath(const std::vector<std::vector<int>> &interest_points,
-                    std::vector<int> &obstacles, compareLine leftLine, compareLine rightLine) {
-    #if PERCEPTION_DEBUG
-        pcl::ScopeTime t("Check Path");
-    #endif
+//Interest points are tested 8 at a time: a point is in the path when
+//x - z * tan(angle) lies between the two lines' x intercepts
+template <typename Sink>
+bool PCL<Sink>::CheckPath(const InterestPoints &interest_points, compareLine leftLine, compareLine rightLine) {
+    typename Sink::Scope t("Check Path");
 
     bool end = true; 
     double previousDistance = -1;
 
     //if there are no interest points, the distance from the last obstacle should be -1
     distance = previousDistance;
-    
+
+    //compareLine works on integer coordinates, so points are truncated the same way here
+    const float *xs = interest_points.x.data();
+    const float *zs = interest_points.z.data();
+    const float inverseSlope = leftLine.slope != 0 ? 1 / leftLine.slope : 0;
+    const float leftIntercept = leftLine.xIntercept;
+    const float rightIntercept = rightLine.xIntercept;
+    auto inPath = [&](int i) {
+        float offset = std::trunc(xs[i]) - std::trunc(zs[i]) * inverseSlope;
+        return offset >= leftIntercept && offset <= rightIntercept;
+    };
+
+#if defined(__AVX__)
+    const __m256 inverseSlopeV = _mm256_set1_ps(inverseSlope);
+    const __m256 leftV = _mm256_set1_ps(leftIntercept);
+    const __m256 rightV = _mm256_set1_ps(rightIntercept);
+#endif
+
     //Iterate through interest points
-    for(auto cluster : interest_points) {
-        double sizeOfCluster = 0;
+    for(size_t cluster = 0; cluster < interest_points.index.size(); ++cluster) {
+        int first = interest_points.index.offsets[cluster];
+        int last = interest_points.index.offsets[cluster + 1];
+        int i = first;
+        int sizeOfCluster = 0;
         double currentDistance = 0;
-        for (auto index : cluster) {
+
+#if defined(__AVX__)
+        __m256 distanceV = _mm256_setzero_ps();
+        for (; i + 8 <= last; i += 8) {
+            __m256 x = _mm256_loadu_ps(xs + i);
+            __m256 z = _mm256_loadu_ps(zs + i);
+            __m256 offset = _mm256_sub_ps(_mm256_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC),
+                                          _mm256_mul_ps(_mm256_round_ps(z, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC), inverseSlopeV));
+            __m256 mask = _mm256_and_ps(_mm256_cmp_ps(offset, leftV, _CMP_GE_OQ), _mm256_cmp_ps(offset, rightV, _CMP_LE_OQ));
+            int bits = _mm256_movemask_ps(mask);
+            if (!bits) {
+                continue;
+            }
+
+            //adds distance from a point in a cluster to currentDistance, and keeps track of the cluster size
+            sizeOfCluster += __builtin_popcount(bits);
+            distanceV = _mm256_add_ps(distanceV, _mm256_and_ps(mask, z));
+        }
+        alignas(32) float laneDistance[8];
+        _mm256_store_ps(laneDistance, distanceV);
+        for (float d : laneDistance) {
+            currentDistance += d;
+        }
+#endif
+
+        for (; i < last; ++i) {
             //Check if the obstacle interest point is to the right of the left projected path of the rover 
             //and to the left of the right projected path of the rover
-            if(leftLine(pt_cloud_ptr->points[index].x, pt_cloud_ptr->points[index].z) >= 0 &&
-                rightLine(pt_cloud_ptr->points[index].x, pt_cloud_ptr->points[index].z) <= 0) {
-                end = false;
-
-                //Check if obstacles is initialized
-                if(obstacles.size() == 0) {
-                    obstacles.push_back(index);
-                    obstacles.push_back(index);
-                }
-                //Check if leftmost interest point in rover path
-                else if(pt_cloud_ptr->points[index].x < pt_cloud_ptr->points[obstacles.at(0)].x) {
-                    obstacles.at(0) = index;
-                }
-                //Check if rightmost interest point in rover path
-                else if(pt_cloud_ptr->points[index].x > pt_cloud_ptr->points[obstacles.at(1)].x) {
-                    obstacles.at(1) = index;
-                }
+            if (inPath(i)) {
+                currentDistance += zs[i];
+                sizeOfCluster++;
+            }
+        }
 
-                #if PERCEPTION_DEBUG
-                    //Make interest points orange if they are within rover path
-                    pt_cloud_ptr->points[index].r = 255;
-                    pt_cloud_ptr->points[index].g = 69;
-                    pt_cloud_ptr->points[index].b = 0;
-                #endif
+        if (sizeOfCluster != 0) {
+            end = false;
+        }
 
-                //adds distance from a point in a cluster to currentDistance, and keeps track of the cluster size
-                currentDistance += pt_cloud_ptr->points[index].z;
-                sizeOfCluster++; 
+        if (Sink::ENABLED) {
+            //Make interest points orange if they are within rover path
+            for (int j = first; j < last; ++j) {
+                if (inPath(j)) {
+                    Sink::color(pt_cloud_ptr->points[interest_points.index.indices[j]], 255, 69, 0);
+                }
             }
         }
+
         //to find the distance from an obstacle detected, add up all the z values from a given cluster of points
         //then divide by the number of points in the cluster
         currentDistance = 1.0 * currentDistance / sizeOfCluster;
@@ -410,7 +486,7 @@ bool PCL::CheckPath(const std::vector<std::vector<int>> &interest_points,
         }
     }
 
-    #if PERCEPTION_DEBUG
+    if (Sink::ENABLED) {
         //Project path in viewer
         pcl::PointXYZRGB pt1;
         pt1.x = leftLine.xIntercept;
@@ -448,13 +524,19 @@ bool PCL::CheckPath(const std::vector<std::vector<int>> &interest_points,
             viewer->addLine(pt1, pt3, 255, 0, 0, "l1");
             viewer->addLine(pt2, pt4, 255, 0, 0, "l2");
         }
-    #endif
+    }
 
     return end;
 }
 
 
-void PCL::updateViewer(bool is_original) {
+template <typename Sink>
+void PCL<Sink>::updateViewer(bool is_original) {
+    //There are only viewers when debugging
+    if (!Sink::ENABLED) {
+        return;
+    }
+
     if(is_original) {
         viewer_original->updatePointCloud(pt_cloud_ptr);
         viewer_original->spinOnce(10);
@@ -467,11 +549,12 @@ void PCL::updateViewer(bool is_original) {
 }
 /* --- Create Visualizer --- */
 //Creates a point cloud visualizer
-shared_ptr<pcl::visualization::PCLVisualizer> PCL::createRGBVisualizer() {
+template <typename Sink>
+shared_ptr<pcl::visualization::PCLVisualizer> PCL<Sink>::createRGBVisualizer() {
     // Open 3D viewer and add point cloud
 
-    //Creates visualizer with window if PERCEPTION_DEBUG is true, and mutes output otherwise
-    shared_ptr<pcl::visualization::PCLVisualizer> viewer(new pcl::visualization::PCLVisualizer("PCL ZED 3D Viewer", PERCEPTION_DEBUG));
+    //Creates visualizer with window when debugging, and mutes output otherwise
+    shared_ptr<pcl::visualization::PCLVisualizer> viewer(new pcl::visualization::PCLVisualizer("PCL ZED 3D Viewer", Sink::ENABLED));
 
     viewer->setBackgroundColor(0.12, 0.12, 0.12);
     pcl::visualization::PointCloudColorHandlerRGBField<pcl::PointXYZRGB> rgb(pt_cloud_ptr);
@@ -487,36 +570,42 @@ shared_ptr<pcl::visualization::PCLVisualizer> PCL::createRGBVisualizer() {
 /* --- Main --- */
 //This is the main point cloud processing function
 //It returns the bearing the rover should traverse
-//For the PassThroughFilter function we can trust the ZED depth for up to 7000 mm (7 m) for "z" axis.
+//For the pass through bounds we can trust the ZED depth for up to 7000 mm (7 m) for "z" axis.
 //3000 mm (3m) for "x" is a placeholder, we will chnage this value based on further testing.
 //This function is called in main.cpp
-void PCL::pcl_obstacle_detection() {
+template <typename Sink>
+void PCL<Sink>::pcl_obstacle_detection() {
+    //Everything allocated for the previous frame is released at once
+    arena.reset();
+
     obstacle_return result;
-    PassThroughFilter("z", UP_BD_Z);
-    PassThroughFilter("y", UP_BD_Y);
-    DownsampleVoxelFilter();
+    stagePointsIn[STAGE_PASS_THROUGH] = pt_cloud_ptr->points.size();
+    PassThroughVoxelFilter();
+    stagePointsOut[STAGE_PASS_THROUGH] = stagePointsIn[STAGE_VOXEL] = voxel_entries.size();
+    stagePointsOut[STAGE_VOXEL] = stagePointsIn[STAGE_RANSAC] = pt_cloud_ptr->points.size();
     RANSACSegmentation("remove");
-    std::vector<pcl::PointIndices> cluster_indices;
+    stagePointsOut[STAGE_RANSAC] = stagePointsIn[STAGE_CLUSTERING] = pt_cloud_ptr->points.size();
+    ClusterIndices cluster_indices(arena);
     CPUEuclidianClusterExtraction(cluster_indices);
-    std::vector<std::vector<int>> interest_points(cluster_indices.size(), vector<int> (6));
+    stagePointsOut[STAGE_CLUSTERING] = stagePointsIn[STAGE_INTEREST_POINTS] = cluster_indices.indices.size();
+    InterestPoints interest_points(arena);
     FindInterestPoints(cluster_indices, interest_points);
-    FindClearPath(interest_points); 
+    stagePointsOut[STAGE_INTEREST_POINTS] = stagePointsIn[STAGE_CLEAR_PATH] = interest_points.x.size();
+    FindClearPath(interest_points);
+    stagePointsOut[STAGE_CLEAR_PATH] = interest_points.x.size();
+
+    //The grid gets every clustered point, so each cell an obstacle covers is hit
+    //instead of only the cells its interest points happen to land in
+    obstacleX.clear();
+    obstacleZ.clear();
+    for (int index : cluster_indices.indices) {
+        obstacleX.push_back(pt_cloud_ptr->points[index].x);
+        obstacleZ.push_back(pt_cloud_ptr->points[index].z);
+    }
 }
 
-
-
-/* --- Update --- */
-//Cleares and resizes cloud for new data
-void PCL::update() {
-    pt_cloud_ptr->clear();
-    pt_cloud_ptr->points.resize(cloudArea);
-    pt_cloud_ptr->width = PT_CLOUD_WIDTH;
-    pt_cloud_ptr->height = PT_CLOUD_HEIGHT;
-
-    #if PERCEPTION_DEBUG
-        std::cout << "Width: " << pt_cloud_ptr->width << std::endl;
-        std::cout << "Height: " << pt_cloud_ptr->height << "\n";
-    #endif
-}
+//Both pipelines are built here, main picks one at startup
+template class PCL<NullSink>;
+template class PCL<DebugSink>;
 
 #endif
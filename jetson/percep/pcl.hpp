@@ -2,6 +2,13 @@
 #pragma once
 
 #include "perception.hpp"
+#include "grid_cluster.hpp"
+#include "frame_arena.hpp"
+#include "polar_clear_path.hpp"
+#include "ground_plane_tracker.hpp"
+#include "parallel_plane_ransac.hpp"
+#include "stage_timer.hpp"
+#include "debug_sink.hpp"
 #include <pcl/common/common_headers.h>
 #include <float.h>
 
@@ -47,6 +54,26 @@ public:
     }
 };
 
+/* --- Interest Points --- */
+//Interest points of every cluster as flat arrays of their x and z coordinates
+//so the path checks can test them in SIMD registers without touching the cloud
+//index holds the cloud index of each point and where each cluster starts
+struct InterestPoints {
+    ClusterIndices index;
+    ArenaVector<float> x;
+    ArenaVector<float> z;
+
+    explicit InterestPoints(FrameArena &arena) :
+        index{arena}, x{ArenaAllocator<float>(arena)}, z{ArenaAllocator<float>(arena)} {}
+};
+
+/* --- PCL --- */
+/**
+\brief Point cloud obstacle detection, from filtering through the clear path
+Sink is NullSink or DebugSink and decides whether the stages time themselves,
+print and color points for the viewers, see debug_sink.hpp
+*/
+template <typename Sink>
 class PCL {
     public:
         shared_ptr<pcl::visualization::PCLVisualizer> viewer;
@@ -81,47 +108,79 @@ class PCL {
         pcl::PointCloud<pcl::PointXYZRGB>::Ptr pt_cloud_ptr;
         int cloudArea;
 
+        //Milliseconds each stage of pcl_obstacle_detection took on the last frame
+        double stageTimes[NUM_OBSTACLE_STAGES] = {};
+
+        //Points each stage took in and passed on during the last frame
+        int stagePointsIn[NUM_OBSTACLE_STAGES] = {};
+        int stagePointsOut[NUM_OBSTACLE_STAGES] = {};
+
+        //Clustered points of the last frame in mm, x to the right and z forward, for the occupancy grid
+        std::vector<float> obstacleX;
+        std::vector<float> obstacleZ;
+
+    private:
+        //Voxel a filtered point falls in, packed z-major so sorting groups each voxel
+        struct VoxelEntry {
+            uint64_t key;
+            int index;
+        };
+
+        //Preallocated output of PassThroughVoxelFilter, swapped with pt_cloud_ptr every frame
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr filtered_cloud_ptr;
+        std::vector<VoxelEntry> voxel_entries;
+
+        //Clustering engine used by CPUEuclidianClusterExtraction
+        GridClusterExtraction clusterer;
+
+        //Scratch memory for everything that only lives for one frame, reset by pcl_obstacle_detection
+        FrameArena arena;
+
+        //Histogram of bearings blocked by interest points, used to find the clear left and right paths
+        PolarClearPath clearPath;
+
+        //Ground plane found by RANSACSegmentation
+        pcl::ModelCoefficients::Ptr ground_coefficients;
+        pcl::PointIndices::Ptr ground_inliers;
+
+        //Keeps the ground plane between frames so RANSAC only runs when it stops fitting
+        GroundPlaneTracker planeTracker;
+
+        //Finds the ground plane from scratch when tracking loses it
+        ParallelPlaneRansac groundRansac;
+
+    public:
+
         //Constructor
         PCL(const rapidjson::Document &mRoverConfig);
 
         //Destructor for PCL
         ~PCL() {
-        #if OBSTACLE_DETECTION && PERCEPTION_DEBUG 
-            viewer -> close();
-            viewer_original -> close();
-        #endif
+            if (Sink::ENABLED) {
+                viewer -> close();
+                viewer_original -> close();
+            }
         };
 
     private:
 
-        //Filters points with values beyond certain threshold
-        void PassThroughFilter(const std::string axis, const double upperLimit);
-        
-        //Clusters nearby points to reduce total number of points
-        void DownsampleVoxelFilter();
+        //Applies the z and y pass through bounds and the voxel downsample in one sweep
+        void PassThroughVoxelFilter();
         
         //Finds the ground plane
         void RANSACSegmentation(string type);
         
         //Clusters nearby points into large obstacles
-        void CPUEuclidianClusterExtraction(std::vector<pcl::PointIndices> &cluster_indices);
+        void CPUEuclidianClusterExtraction(ClusterIndices &cluster_indices);
         
         //Finds the four corners of the clustered obstacles
-        void FindInterestPoints(std::vector<pcl::PointIndices> &cluster_indices, std::vector<std::vector<int>> &interest_points);
+        void FindInterestPoints(const ClusterIndices &cluster_indices, InterestPoints &interest_points);
         
         //Finds a clear path given the obstacle corners
-        void FindClearPath(const std::vector<std::vector<int>> &interest_points);
+        void FindClearPath(const InterestPoints &interest_points);
 
         //Determines whether the input path is obstructed
-        bool CheckPath(const std::vector<std::vector<int>> &interest_points,
-               std::vector<int> &obstacles, compareLine leftLine, compareLine rightLine);
-        
-        /**
-        \brief Determines angle off center a clear path can be found
-        \param direction: given 0 finds left clear path given 1 find right clear path
-        */
-        double getAngleOffCenter(int buffer, int direction, const std::vector<std::vector<int>> &interest_points,
-                    std::vector<int> &obstacles);
+        bool CheckPath(const InterestPoints &interest_points, compareLine leftLine, compareLine rightLine);
 
     public:
         //Main function that runs the above 
@@ -133,9 +192,6 @@ class PCL {
         
         //Creates a point cloud visualizer
         shared_ptr<pcl::visualization::PCLVisualizer> createRGBVisualizer();
-
-        //Cleares and resizes cloud for new data
-        void update();
 };
 
 #endif
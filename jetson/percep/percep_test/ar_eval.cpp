@@ -0,0 +1,294 @@
+#include "perception.hpp"
+#include "thread_pool.hpp"
+#include "stage_timer.hpp"
+#include <map>
+#include <memory>
+#include <sstream>
+
+using namespace cv;
+using namespace std;
+
+/* --- Percep AR Eval --- */
+//Runs TagDetector over a labelled image set and reports how accurate and how fast it is,
+//once for every configuration in a variants file so detector parameters can be compared
+//Usage: percep_ar_eval <labels.csv> [variants.json] [threads] [match radius px]
+//
+//labels.csv has a line per labelled tag: image,depth,id,x,y,distance,bearing
+//Paths are relative to the csv, depth (.exr in mm), distance (m) and bearing (degrees) can
+//be left empty, and an image without any tags is listed once with an id of -1
+//
+//variants.json is an array of {"name": ..., "alvar_params": {...}}, each alvar_params
+//overriding those in the percep config. Without it only the config itself is evaluated
+//Frames are independent, so tracking between frames is turned off for every variant
+
+namespace {
+    struct Label {
+        int id;
+        Point2f loc;
+        double distance;
+        double bearing;
+    };
+
+    struct Sample {
+        string name;
+        Mat image;
+        Mat depth;
+        vector<Label> labels;
+    };
+
+    //Counts and errors from one thread's share of the images
+    struct Score {
+        int truePositives = 0;
+        int falsePositives = 0;
+        int falseNegatives = 0;
+        vector<double> pixelErrors;
+        vector<double> bearingErrors;
+        vector<double> distanceErrors;
+        vector<double> frameTimes;
+
+        void add(const Score &other) {
+            truePositives += other.truePositives;
+            falsePositives += other.falsePositives;
+            falseNegatives += other.falseNegatives;
+            pixelErrors.insert(pixelErrors.end(), other.pixelErrors.begin(), other.pixelErrors.end());
+            bearingErrors.insert(bearingErrors.end(), other.bearingErrors.begin(), other.bearingErrors.end());
+            distanceErrors.insert(distanceErrors.end(), other.distanceErrors.begin(), other.distanceErrors.end());
+            frameTimes.insert(frameTimes.end(), other.frameTimes.begin(), other.frameTimes.end());
+        }
+    };
+
+    void readConfig(const string &path, rapidjson::Document &document) {
+        ifstream file(path);
+        string json, setting;
+        while (file >> setting) {
+            json += setting;
+        }
+        document.Parse(json.c_str());
+    }
+
+    double parseOr(const string &field, double fallback) {
+        return field.empty() ? fallback : atof(field.c_str());
+    }
+
+    //Reads the labels and loads every image they name, in the order they first appear
+    vector<Sample> loadSamples(const string &labelsPath) {
+        string folder = labelsPath.substr(0, labelsPath.find_last_of('/') + 1);
+        vector<Sample> samples;
+        map<string, size_t> indices;
+
+        ifstream file(labelsPath);
+        string line;
+        while (getline(file, line)) {
+            if (line.empty() || line[0] == '#' || line.compare(0, 5, "image") == 0) {
+                continue;
+            }
+            vector<string> fields;
+            stringstream stream(line);
+            string field;
+            while (getline(stream, field, ',')) {
+                fields.push_back(field);
+            }
+            fields.resize(7);
+
+            auto found = indices.find(fields[0]);
+            if (found == indices.end()) {
+                Sample sample;
+                sample.name = fields[0];
+                Mat bgr = imread(folder + fields[0], IMREAD_COLOR);
+                if (!bgr.data) {
+                    cerr << "Skipping " << fields[0] << ", couldn't load it\n";
+                    continue;
+                }
+                //The detector takes frames laid out the way the ZED hands them over
+                cvtColor(bgr, sample.image, COLOR_BGR2BGRA);
+                if (!fields[1].empty()) {
+                    sample.depth = imread(folder + fields[1], IMREAD_ANYCOLOR | IMREAD_ANYDEPTH);
+                }
+                if (!sample.depth.data) {
+                    //Without depth every range comes from the tag's pose
+                    sample.depth = Mat(sample.image.rows, sample.image.cols, CV_32FC1, Scalar(NAN));
+                }
+                found = indices.emplace(fields[0], samples.size()).first;
+                samples.push_back(sample);
+            }
+
+            int id = atoi(fields[2].c_str());
+            if (id >= 0) {
+                samples[found->second].labels.push_back(Label{id, Point2f(atof(fields[3].c_str()), atof(fields[4].c_str())),
+                                                              parseOr(fields[5], NAN), parseOr(fields[6], NAN)});
+            }
+        }
+        return samples;
+    }
+
+    //Matches detections to labels with the same id, nearest first, within radius pixels
+    void scoreFrame(const Sample &sample, const vector<Tag> &tags, const vector<rover_msgs::Target> &targets,
+                    double radius, Score &score) {
+        vector<bool> labelUsed(sample.labels.size(), false);
+        for (size_t t = 0; t < tags.size(); ++t) {
+            int best = -1;
+            double bestDistance = radius;
+            for (size_t l = 0; l < sample.labels.size(); ++l) {
+                if (labelUsed[l] || sample.labels[l].id != tags[t].id) {
+                    continue;
+                }
+                double d = norm(tags[t].loc - sample.labels[l].loc);
+                if (d <= bestDistance) {
+                    best = static_cast<int>(l);
+                    bestDistance = d;
+                }
+            }
+            if (best == -1) {
+                ++score.falsePositives;
+                continue;
+            }
+
+            labelUsed[best] = true;
+            ++score.truePositives;
+            const Label &label = sample.labels[best];
+            score.pixelErrors.push_back(bestDistance);
+            if (!isnan(label.bearing)) {
+                score.bearingErrors.push_back(fabs(targets[t].bearing - label.bearing));
+            }
+            if (!isnan(label.distance)) {
+                score.distanceErrors.push_back(fabs(targets[t].distance - label.distance));
+            }
+        }
+        for (bool used : labelUsed) {
+            score.falseNegatives += !used;
+        }
+    }
+
+    double mean(const vector<double> &values) {
+        double total = 0;
+        for (double value : values) {
+            total += value;
+        }
+        return values.empty() ? NAN : total / values.size();
+    }
+
+    double percentile(vector<double> values, double fraction) {
+        if (values.empty()) {
+            return NAN;
+        }
+        size_t index = min(static_cast<size_t>(fraction * (values.size() - 1) + 0.5), values.size() - 1);
+        nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <labels.csv> [variants.json] [threads] [match radius px]\n";
+        return 1;
+    }
+    int numThreads = argc > 3 ? max(atoi(argv[3]), 1) : max(static_cast<int>(thread::hardware_concurrency()), 1);
+    double radius = argc > 4 ? atof(argv[4]) : 40;
+
+    /* --- Reading in Config File --- */
+    rapidjson::Document baseConfig;
+    string configPath = getenv("MROVER_CONFIG");
+    readConfig(configPath + "/config_percep/config.json", baseConfig);
+
+    //Every variant is the base config with its alvar_params laid over it
+    vector<string> names;
+    vector<unique_ptr<rapidjson::Document>> configs;
+    rapidjson::Document variants;
+    if (argc > 2) {
+        readConfig(argv[2], variants);
+        if (variants.HasParseError() || !variants.IsArray()) {
+            cerr << "Couldn't read the variants in " << argv[2] << "\n";
+            return 1;
+        }
+        for (rapidjson::SizeType v = 0; v < variants.Size(); ++v) {
+            unique_ptr<rapidjson::Document> config(new rapidjson::Document);
+            config->CopyFrom(baseConfig, config->GetAllocator());
+            rapidjson::Value &params = (*config)["alvar_params"];
+            for (auto member = variants[v]["alvar_params"].MemberBegin(); member != variants[v]["alvar_params"].MemberEnd(); ++member) {
+                rapidjson::Value value(member->value, config->GetAllocator());
+                if (params.HasMember(member->name)) {
+                    params[member->name] = value;
+                } else {
+                    rapidjson::Value name(member->name, config->GetAllocator());
+                    params.AddMember(name, value, config->GetAllocator());
+                }
+            }
+            names.push_back(variants[v]["name"].GetString());
+            configs.push_back(move(config));
+        }
+    } else {
+        unique_ptr<rapidjson::Document> config(new rapidjson::Document);
+        config->CopyFrom(baseConfig, config->GetAllocator());
+        names.push_back("config");
+        configs.push_back(move(config));
+    }
+    for (auto &config : configs) {
+        (*config)["ar_tag"]["roi"]["tracking"].SetInt(0);
+    }
+
+    /* --- Preload Frames --- */
+    vector<Sample> samples = loadSamples(argv[1]);
+    size_t numLabels = 0;
+    for (const Sample &sample : samples) {
+        numLabels += sample.labels.size();
+    }
+    cout << "Loaded " << samples.size() << " images with " << numLabels << " labelled tags, evaluating on "
+         << numThreads << " threads\n\n";
+    if (samples.empty()) {
+        return 1;
+    }
+
+    /* --- Evaluate Every Variant --- */
+    ThreadPool pool(numThreads);
+    printf("%-20s %9s %9s %10s %10s %10s %10s %10s %9s %9s\n", "variant", "precision", "recall", "px_mean",
+           "bear_mean", "bear_p95", "dist_mean", "dist_p95", "fps", "fps/core");
+    for (size_t v = 0; v < configs.size(); ++v) {
+        //Detectors keep buffers between frames, so every thread gets its own
+        vector<unique_ptr<TagDetector>> detectors;
+        for (int t = 0; t < pool.size(); ++t) {
+            detectors.emplace_back(new TagDetector(*configs[v]));
+        }
+        vector<Score> scores(pool.size());
+
+        double wallTime;
+        {
+            StageTimer timer(wallTime);
+            pool.run([&](int t) {
+                TagDetector &detector = *detectors[t];
+                Score &score = scores[t];
+                Mat rgb;
+                vector<rover_msgs::Target> targets;
+                for (size_t i = t; i < samples.size(); i += pool.size()) {
+                    Sample &sample = samples[i];
+                    vector<Tag> tags;
+                    double frameTime;
+                    {
+                        StageTimer frameTimer(frameTime);
+                        tags = detector.findARTags(sample.image, sample.depth, rgb);
+                        targets.clear();
+                        for (const Tag &tag : tags) {
+                            targets.push_back(detector.measureTag(tag, sample.depth));
+                        }
+                    }
+                    score.frameTimes.push_back(frameTime);
+                    scoreFrame(sample, tags, targets, radius, score);
+                }
+            });
+        }
+
+        Score total;
+        for (const Score &score : scores) {
+            total.add(score);
+        }
+        int detected = total.truePositives + total.falsePositives;
+        int labelled = total.truePositives + total.falseNegatives;
+        printf("%-20s %9.3f %9.3f %10.2f %10.3f %10.3f %10.3f %10.3f %9.1f %9.1f\n", names[v].c_str(),
+               detected ? static_cast<double>(total.truePositives) / detected : NAN,
+               labelled ? static_cast<double>(total.truePositives) / labelled : NAN,
+               mean(total.pixelErrors), mean(total.bearingErrors), percentile(total.bearingErrors, 0.95),
+               mean(total.distanceErrors), percentile(total.distanceErrors, 0.95),
+               samples.size() * 1000.0 / wallTime, 1000.0 / mean(total.frameTimes));
+    }
+
+    return 0;
+}
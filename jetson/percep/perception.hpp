@@ -54,6 +54,12 @@
 
 #define PI 3.14159265
 
+//Microseconds since the epoch, the clock frames are stamped with
+inline int64_t microsecondsSinceEpoch() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
 class obstacle_return {
   public:
   double leftBearing;
@@ -70,17 +76,6 @@ class obstacle_return {
                   leftBearing{left_bearing_in}, rightBearing{right_bearing_in}, 
                   distance{distance_in} {}
 
-  obstacle_return& operator=(obstacle_return & in){
-    if(this == &in){
-      return *this;
-    }
-    
-    leftBearing = in.leftBearing;
-    rightBearing = in.rightBearing;
-    distance = in.distance;
-    return *this;
-  }
-
 };
 
 //ar tag detector class
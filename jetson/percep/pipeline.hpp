@@ -0,0 +1,94 @@
+#pragma once
+
+#include "perception.hpp"
+#include "rover_msgs/TargetList.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/* --- Bounded Queue --- */
+/**
+\brief Blocking FIFO with a fixed capacity used to hand frames between
+pipeline stages. push blocks while the queue is full so a slow stage
+throttles the stages before it instead of letting frames pile up
+*/
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity{capacity} {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+    }
+
+    //Pushes without blocking, returns false and leaves item alone if the queue is full
+    bool tryPush(T &item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.size() >= capacity) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    T pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return !items.empty(); });
+        T item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return item;
+    }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+};
+
+/* --- Frame --- */
+//Everything captured from the camera for one grab
+//Frames are preallocated and recycled through a free queue so the
+//capture stage never allocates new image or cloud buffers
+struct Frame {
+    int id;
+
+    //When the camera captured it, microseconds since the epoch
+    int64_t timestamp;
+
+    #if AR_DETECTION
+    cv::Mat src;
+    #endif
+
+    #if AR_DETECTION || OBSTACLE_DETECTION
+    cv::Mat depth_img;
+    #endif
+
+    #if OBSTACLE_DETECTION
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+    #endif
+
+    Frame() : id{-1}, timestamp{0}
+    #if OBSTACLE_DETECTION
+        , cloud{new pcl::PointCloud<pcl::PointXYZRGB>}
+    #endif
+    {}
+};
+
+//Output of the AR tag stage for a single frame
+struct ArResult {
+    Frame *frame;
+    rover_msgs::TargetList targets;
+};
+
+//Output of the obstacle stage for a single frame
+struct ObstacleResult {
+    Frame *frame;
+    obstacle_return obstacle;
+};
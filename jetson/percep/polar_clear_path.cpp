@@ -0,0 +1,79 @@
+#include "polar_clear_path.hpp"
+#include "perception.hpp"
+
+PolarClearPath::PolarClearPath(double maxAngle, double binSize, double halfWidth) :
+    maxAngle{maxAngle}, binSize{binSize}, halfWidth{halfWidth},
+    numBins{static_cast<int>(std::ceil(2 * maxAngle / binSize))}, built{true},
+    diff(numBins + 1, 0), blocked(numBins, 0) {}
+
+void PolarClearPath::clear() {
+    std::fill(diff.begin(), diff.end(), 0);
+    std::fill(blocked.begin(), blocked.end(), 0);
+    built = true;
+}
+
+int PolarClearPath::binOf(double angle) const {
+    int bin = static_cast<int>(std::floor((angle + maxAngle) / binSize));
+    return std::min(std::max(bin, 0), numBins - 1);
+}
+
+void PolarClearPath::addPoint(float x, float z) {
+    //Points at or behind the camera can't be in the way of any heading
+    if (z <= 0) {
+        return;
+    }
+
+    double lower = atan((x - halfWidth) / z) * 180 / PI;
+    double upper = atan((x + halfWidth) / z) * 180 / PI;
+    if (upper < -maxAngle || lower > maxAngle) {
+        return;
+    }
+
+    ++diff[binOf(lower)];
+    --diff[binOf(upper) + 1];
+    built = false;
+}
+
+void PolarClearPath::addPoints(const float *x, const float *z, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        addPoint(x[i], z[i]);
+    }
+}
+
+void PolarClearPath::build() {
+    if (built) {
+        return;
+    }
+    int running = 0;
+    for (int i = 0; i < numBins; ++i) {
+        running += diff[i];
+        blocked[i] = running;
+    }
+    built = true;
+}
+
+bool PolarClearPath::isBlocked(double angle) {
+    build();
+    return blocked[binOf(angle)] != 0;
+}
+
+double PolarClearPath::findBearing(int direction) {
+    build();
+
+    //Walk out from the bin holding center, the first free bin's edge nearest center is the bearing
+    int center = binOf(0);
+    if (direction) {
+        for (int i = center; i < numBins; ++i) {
+            if (!blocked[i]) {
+                return i == center ? 0 : i * binSize - maxAngle;
+            }
+        }
+        return maxAngle;
+    }
+    for (int i = center; i >= 0; --i) {
+        if (!blocked[i]) {
+            return i == center ? 0 : (i + 1) * binSize - maxAngle;
+        }
+    }
+    return -maxAngle;
+}
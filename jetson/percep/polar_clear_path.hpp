@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/* --- Polar Clear Path --- */
+/**
+\brief Finds the nearest clear bearings from a histogram of blocked bearings
+Every obstacle point blocks the range of headings whose path would pass
+within halfWidth of it, that is every angle with tan(angle) between
+(x - halfWidth) / z and (x + halfWidth) / z. The ranges are added to a
+histogram of bins across the field of view, after which the nearest free
+bearing on either side of center is a single scan away
+*/
+class PolarClearPath {
+public:
+    //maxAngle and binSize are in degrees, halfWidth in the units of the points
+    PolarClearPath(double maxAngle, double binSize, double halfWidth);
+
+    //Empties the histogram, keeping its memory
+    void clear();
+
+    //Blocks the bearings a point at lateral offset x and forward distance z is in the way of
+    void addPoint(float x, float z);
+    void addPoints(const float *x, const float *z, size_t count);
+
+    //Returns the free bearing nearest center in the given direction, 0 is left and 1 is right
+    //If every bearing up to maxAngle is blocked, returns -maxAngle or maxAngle
+    double findBearing(int direction);
+
+    //Returns whether the bin holding angle is blocked
+    bool isBlocked(double angle);
+
+private:
+    //Accumulates the difference array into per bin counts if points were added since
+    void build();
+
+    //Bin that angle falls in, clamped to the histogram
+    int binOf(double angle) const;
+
+    double maxAngle;
+    double binSize;
+    double halfWidth;
+    int numBins;
+    bool built;
+
+    //diff[i] is how many more ranges cover bin i than bin i - 1, blocked the running total
+    std::vector<int> diff;
+    std::vector<int> blocked;
+};
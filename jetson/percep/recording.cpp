@@ -0,0 +1,361 @@
+#include "recording.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace recording;
+
+/* --- Byte Shuffle --- */
+void recording::shuffle(const uint8_t *in, uint8_t *out, size_t size, size_t elementSize) {
+    size_t count = size / elementSize;
+    for (size_t b = 0; b < elementSize; ++b) {
+        uint8_t *plane = out + b * count;
+        for (size_t i = 0; i < count; ++i) {
+            plane[i] = in[i * elementSize + b];
+        }
+    }
+    //Bytes that don't fill a whole element are kept as is
+    memcpy(out + count * elementSize, in + count * elementSize, size - count * elementSize);
+}
+
+void recording::unshuffle(const uint8_t *in, uint8_t *out, size_t size, size_t elementSize) {
+    size_t count = size / elementSize;
+    for (size_t b = 0; b < elementSize; ++b) {
+        const uint8_t *plane = in + b * count;
+        for (size_t i = 0; i < count; ++i) {
+            out[i * elementSize + b] = plane[i];
+        }
+    }
+    memcpy(out + count * elementSize, in + count * elementSize, size - count * elementSize);
+}
+
+/* --- Recording Writer --- */
+RecordingWriter::RecordingWriter(const std::string &path, size_t queueDepth, int compressionLevel) :
+    file{fopen(path.c_str(), "wb")}, offset{0}, compressionLevel{compressionLevel},
+    dropped{0}, failed{false}, queue{queueDepth} {
+    if (!file) {
+        std::cerr << "Couldn't open recording " << path << ": " << strerror(errno) << "\n";
+        return;
+    }
+
+    FileHeader header;
+    memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.chunkAlignment = CHUNK_ALIGNMENT;
+    append(&header, sizeof(header));
+
+    ioThread = std::thread(&RecordingWriter::run, this);
+}
+
+RecordingWriter::~RecordingWriter() {
+    close();
+}
+
+bool RecordingWriter::write(std::unique_ptr<RecordingFrame> frame, bool wait) {
+    if (!file) {
+        ++dropped;
+        return false;
+    }
+    if (wait) {
+        queue.push(std::move(frame));
+        return true;
+    }
+    if (!queue.tryPush(frame)) {
+        ++dropped;
+        return false;
+    }
+    return true;
+}
+
+void RecordingWriter::close() {
+    if (!file) {
+        return;
+    }
+
+    //A null frame tells the I/O thread it has everything
+    queue.push(nullptr);
+    ioThread.join();
+
+    Footer footer;
+    memcpy(footer.magic, INDEX_MAGIC, sizeof(footer.magic));
+    footer.indexOffset = offset;
+    footer.entryCount = index.size();
+    footer.reserved = 0;
+    append(index.data(), index.size() * sizeof(IndexEntry));
+    append(&footer, sizeof(footer));
+
+    fclose(file);
+    file = nullptr;
+
+    if (dropped) {
+        std::cerr << "Recording dropped " << dropped << " frames, the disk couldn't keep up\n";
+    }
+}
+
+void RecordingWriter::run() {
+    while (std::unique_ptr<RecordingFrame> frame = queue.pop()) {
+        if (!frame->rgb.empty()) {
+            //rgb stays lossy like the jpgs it replaces, it's by far the largest part of a frame otherwise
+            std::vector<uint8_t> jpeg;
+            cv::imencode(".jpg", frame->rgb, jpeg, {cv::IMWRITE_JPEG_QUALITY, 95});
+            ChunkHeader header{CHUNK_SYNC, CHUNK_RGB, CODEC_JPEG, frame->id, frame->rgb.rows, frame->rgb.cols,
+                               frame->rgb.type(), static_cast<uint32_t>(frame->rgb.elemSize()),
+                               frame->rgb.total() * frame->rgb.elemSize(), jpeg.size()};
+            writeEncodedChunk(header, jpeg.data());
+        }
+
+        if (!frame->depth.empty()) {
+            cv::Mat depth = frame->depth.isContinuous() ? frame->depth : frame->depth.clone();
+            writeChunk(CHUNK_DEPTH, frame->id, depth.rows, depth.cols, depth.type(),
+                       depth.data, depth.total() * depth.elemSize(), depth.elemSize() / depth.channels());
+        }
+
+        #if OBSTACLE_DETECTION
+        if (!frame->cloud.points.empty()) {
+            //Split the points into planes so each coordinate compresses against its neighbors
+            const auto &points = frame->cloud.points;
+            size_t count = points.size();
+            raw.resize(count * 4 * sizeof(float));
+            float *x = reinterpret_cast<float*>(raw.data());
+            float *y = x + count, *z = y + count;
+            uint32_t *rgba = reinterpret_cast<uint32_t*>(z + count);
+            for (size_t i = 0; i < count; ++i) {
+                x[i] = points[i].x;
+                y[i] = points[i].y;
+                z[i] = points[i].z;
+                rgba[i] = points[i].rgba;
+            }
+            writeChunk(CHUNK_CLOUD, frame->id, frame->cloud.height, frame->cloud.width, 0,
+                       raw.data(), raw.size(), sizeof(float));
+        }
+        #endif
+    }
+}
+
+void RecordingWriter::writeChunk(ChunkType type, int frameId, int rows, int cols, int cvType,
+                                 const uint8_t *data, size_t size, size_t elementSize) {
+    ChunkHeader header{CHUNK_SYNC, type, CODEC_RAW, frameId, rows, cols, cvType,
+                       static_cast<uint32_t>(elementSize), size, size};
+    const uint8_t *payload = data;
+
+    shuffled.resize(size);
+    shuffle(data, shuffled.data(), size, elementSize);
+    uLongf compressedSize = compressBound(size);
+    compressed.resize(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, shuffled.data(), size, compressionLevel) == Z_OK &&
+        compressedSize < size) {
+        header.codec = CODEC_SHUFFLE_ZLIB;
+        header.storedSize = compressedSize;
+        payload = compressed.data();
+    }
+    writeEncodedChunk(header, payload);
+}
+
+void RecordingWriter::writeEncodedChunk(const ChunkHeader &header, const uint8_t *payload) {
+    index.push_back(IndexEntry{offset, header.frameId, header.type});
+    append(&header, sizeof(header));
+    append(payload, header.storedSize);
+
+    static const uint8_t zeros[CHUNK_ALIGNMENT] = {};
+    append(zeros, padding(header.storedSize));
+}
+
+void RecordingWriter::append(const void *data, size_t size) {
+    if (failed || size == 0) {
+        return;
+    }
+    if (fwrite(data, 1, size, file) != size) {
+        //Keep draining the queue so the caller never blocks, nothing more is written
+        std::cerr << "Recording write failed: " << strerror(errno) << "\n";
+        failed = true;
+        return;
+    }
+    offset += size;
+}
+
+/* --- Recording Reader --- */
+RecordingReader::RecordingReader() : mapping{nullptr}, mappingSize{0} {}
+
+RecordingReader::~RecordingReader() {
+    close();
+}
+
+bool RecordingReader::open(const std::string &path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "Couldn't open recording " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || static_cast<size_t>(info.st_size) < sizeof(FileHeader)) {
+        std::cerr << path << " is not a recording\n";
+        ::close(fd);
+        return false;
+    }
+
+    //Private and writable so views can be handed out as cv::Mats, writes only touch this process's pages
+    mappingSize = info.st_size;
+    void *address = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        std::cerr << "Couldn't map recording " << path << ": " << strerror(errno) << "\n";
+        mappingSize = 0;
+        return false;
+    }
+    mapping = static_cast<uint8_t*>(address);
+
+    const FileHeader *header = reinterpret_cast<const FileHeader*>(mapping);
+    if (memcmp(header->magic, FILE_MAGIC, sizeof(header->magic)) != 0 || header->version != VERSION) {
+        std::cerr << path << " is not a recording this version can read\n";
+        close();
+        return false;
+    }
+
+    //Use the index if the recording was closed, otherwise walk every chunk that made it to disk
+    std::map<int, size_t> frameOf;
+    const Footer *footer = nullptr;
+    if (mappingSize >= sizeof(FileHeader) + sizeof(Footer)) {
+        footer = reinterpret_cast<const Footer*>(mapping + mappingSize - sizeof(Footer));
+        uint64_t indexSize = mappingSize - sizeof(Footer) - footer->indexOffset;
+        if (memcmp(footer->magic, INDEX_MAGIC, sizeof(footer->magic)) != 0 ||
+            footer->indexOffset > mappingSize - sizeof(Footer) ||
+            indexSize != footer->entryCount * sizeof(IndexEntry)) {
+            footer = nullptr;
+        }
+    }
+    if (footer) {
+        const IndexEntry *entries = reinterpret_cast<const IndexEntry*>(mapping + footer->indexOffset);
+        for (uint64_t i = 0; i < footer->entryCount; ++i) {
+            if (!addChunk(entries[i].offset, frameOf)) {
+                std::cerr << path << " has a corrupt index\n";
+                close();
+                return false;
+            }
+        }
+    }
+    else {
+        uint64_t offset = sizeof(FileHeader);
+        while (offset + sizeof(ChunkHeader) <= mappingSize && addChunk(offset, frameOf)) {
+            const ChunkHeader *chunk = reinterpret_cast<const ChunkHeader*>(mapping + offset);
+            offset += sizeof(ChunkHeader) + chunk->storedSize + padding(chunk->storedSize);
+        }
+        std::cerr << path << " has no index, recovered " << frames.size() << " frames\n";
+    }
+    return true;
+}
+
+void RecordingReader::close() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+    mapping = nullptr;
+    mappingSize = 0;
+    frames.clear();
+}
+
+bool RecordingReader::addChunk(uint64_t offset, std::map<int, size_t> &frameOf) {
+    if (offset + sizeof(ChunkHeader) > mappingSize) {
+        return false;
+    }
+    const ChunkHeader *chunk = reinterpret_cast<const ChunkHeader*>(mapping + offset);
+    if (chunk->sync != CHUNK_SYNC || chunk->type < CHUNK_RGB || chunk->type > CHUNK_CLOUD ||
+        chunk->storedSize > mappingSize - offset - sizeof(ChunkHeader)) {
+        return false;
+    }
+
+    auto found = frameOf.find(chunk->frameId);
+    if (found == frameOf.end()) {
+        found = frameOf.emplace(chunk->frameId, frames.size()).first;
+        frames.push_back(FrameChunks{chunk->frameId, {nullptr, nullptr, nullptr, nullptr}});
+    }
+    frames[found->second].chunks[chunk->type] = chunk;
+    return true;
+}
+
+const uint8_t* RecordingReader::payload(const ChunkHeader *chunk, std::vector<uint8_t> &buffer) {
+    const uint8_t *stored = reinterpret_cast<const uint8_t*>(chunk + 1);
+    if (chunk->codec == CODEC_RAW) {
+        return stored;
+    }
+    if (chunk->codec != CODEC_SHUFFLE_ZLIB) {
+        return nullptr;
+    }
+
+    scratch.resize(chunk->rawSize);
+    buffer.resize(chunk->rawSize);
+    uLongf size = chunk->rawSize;
+    if (uncompress(scratch.data(), &size, stored, chunk->storedSize) != Z_OK || size != chunk->rawSize) {
+        std::cerr << "Corrupt chunk in frame " << chunk->frameId << "\n";
+        return nullptr;
+    }
+    unshuffle(scratch.data(), buffer.data(), size, chunk->elementSize);
+    return buffer.data();
+}
+
+cv::Mat RecordingReader::rgb(size_t frame) {
+    const ChunkHeader *chunk = frames[frame].chunks[CHUNK_RGB];
+    if (!chunk) {
+        return cv::Mat();
+    }
+    uint8_t *stored = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(chunk + 1));
+    if (chunk->codec == CODEC_JPEG) {
+        cv::Mat decoded = cv::imdecode(cv::Mat(1, static_cast<int>(chunk->storedSize), CV_8UC1, stored), cv::IMREAD_UNCHANGED);
+        //JPEG drops the alpha the ZED's frames carry, put it back so replays match live frames
+        if (!decoded.empty() && decoded.channels() == 3 && CV_MAT_CN(chunk->cvType) == 4) {
+            cv::cvtColor(decoded, decoded, cv::COLOR_BGR2BGRA);
+        }
+        return decoded;
+    }
+    return cv::Mat(chunk->rows, chunk->cols, chunk->cvType, stored);
+}
+
+cv::Mat RecordingReader::depth(size_t frame) {
+    const ChunkHeader *chunk = frames[frame].chunks[CHUNK_DEPTH];
+    const uint8_t *data = chunk ? payload(chunk, depthBuffer) : nullptr;
+    if (!data) {
+        return cv::Mat();
+    }
+    return cv::Mat(chunk->rows, chunk->cols, chunk->cvType, const_cast<uint8_t*>(data));
+}
+
+bool RecordingReader::cloud(size_t frame, CloudView &view) {
+    const ChunkHeader *chunk = frames[frame].chunks[CHUNK_CLOUD];
+    const uint8_t *data = chunk ? payload(chunk, cloudBuffer) : nullptr;
+    if (!data) {
+        return false;
+    }
+    size_t count = static_cast<size_t>(chunk->rows) * chunk->cols;
+    view.x = reinterpret_cast<const float*>(data);
+    view.y = view.x + count;
+    view.z = view.y + count;
+    view.rgba = reinterpret_cast<const uint32_t*>(view.z + count);
+    view.width = chunk->cols;
+    view.height = chunk->rows;
+    return true;
+}
+
+#if OBSTACLE_DETECTION
+bool RecordingReader::cloud(size_t frame, pcl::PointCloud<pcl::PointXYZRGB> &cloud) {
+    CloudView view;
+    if (!this->cloud(frame, view)) {
+        return false;
+    }
+    size_t count = view.size();
+    cloud.points.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        cloud.points[i].x = view.x[i];
+        cloud.points[i].y = view.y[i];
+        cloud.points[i].z = view.z[i];
+        cloud.points[i].rgba = view.rgba[i];
+    }
+    cloud.width = view.width;
+    cloud.height = view.height;
+    return true;
+}
+#endif
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "config.h"
+#include "pipeline.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* --- Recording Format --- */
+//A recording is one append-only file of chunks, each holding the rgb image,
+//depth image or point cloud of a frame:
+//
+//  FileHeader | ChunkHeader payload padding | ChunkHeader payload padding | ... | IndexEntry... | Footer
+//
+//Chunk headers and payloads start on CHUNK_ALIGNMENT byte boundaries so raw
+//payloads can be used in place once the file is mapped. The index and footer
+//are written on close, a recording cut off before then can still be read by
+//walking the chunk headers from the start
+namespace recording {
+    const char FILE_MAGIC[8] = {'M', 'R', 'O', 'V', 'R', 'E', 'C', '1'};
+    const char INDEX_MAGIC[8] = {'M', 'R', 'O', 'V', 'I', 'D', 'X', '1'};
+    const uint32_t CHUNK_SYNC = 0x4B4E4843; //"CHNK"
+    const uint32_t VERSION = 1;
+    const size_t CHUNK_ALIGNMENT = 16;
+
+    enum ChunkType : uint32_t {
+        CHUNK_RGB = 1,   //cv::Mat with rows, cols and cvType
+        CHUNK_DEPTH = 2, //CV_32FC1 cv::Mat in mm
+        CHUNK_CLOUD = 3  //rows * cols points stored as four planes: x, y, z floats then packed rgba
+    };
+
+    enum Codec : uint32_t {
+        CODEC_RAW = 0,         //payload is the data as is
+        CODEC_JPEG = 1,        //payload is a JPEG, only used for rgb
+        CODEC_SHUFFLE_ZLIB = 2 //bytes of every elementSize wide element grouped by significance, then zlib
+    };
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t chunkAlignment;
+    };
+
+    struct ChunkHeader {
+        uint32_t sync;
+        uint32_t type;
+        uint32_t codec;
+        int32_t frameId;
+        int32_t rows;
+        int32_t cols;
+        int32_t cvType;
+        uint32_t elementSize;
+        uint64_t rawSize;    //bytes of the data once decoded
+        uint64_t storedSize; //bytes of payload following the header
+    };
+
+    struct IndexEntry {
+        uint64_t offset; //of the chunk header from the start of the file
+        int32_t frameId;
+        uint32_t type;
+    };
+
+    struct Footer {
+        char magic[8];
+        uint64_t indexOffset;
+        uint64_t entryCount;
+        uint64_t reserved;
+    };
+
+    //Bytes needed to bring size up to the next chunk boundary
+    inline size_t padding(size_t size) {
+        return (CHUNK_ALIGNMENT - size % CHUNK_ALIGNMENT) % CHUNK_ALIGNMENT;
+    }
+
+    //Groups byte b of every element together so similar bytes compress well
+    void shuffle(const uint8_t *in, uint8_t *out, size_t size, size_t elementSize);
+    void unshuffle(const uint8_t *in, uint8_t *out, size_t size, size_t elementSize);
+}
+
+/* --- Recording Frame --- */
+//Everything written for a single frame, owned by the writer once queued
+struct RecordingFrame {
+    int id;
+    cv::Mat rgb;
+    cv::Mat depth;
+
+    #if OBSTACLE_DETECTION
+    pcl::PointCloud<pcl::PointXYZRGB> cloud;
+    #endif
+};
+
+/* --- Recording Writer --- */
+/**
+\brief Appends frames to a recording from a background I/O thread
+write() only queues the frame, compression and disk writes happen on the
+writer's own thread so perception never waits on the SD card. If the disk
+falls behind and the queue fills up, new frames are dropped rather than
+stalling the caller
+*/
+class RecordingWriter {
+public:
+    RecordingWriter(const std::string &path, size_t queueDepth, int compressionLevel);
+    ~RecordingWriter();
+
+    bool isOpen() const { return file != nullptr; }
+
+    //Hands frame to the I/O thread, if the queue is full the frame is dropped
+    //and false returned unless wait is set, offline tools wait instead
+    bool write(std::unique_ptr<RecordingFrame> frame, bool wait = false);
+
+    //Writes every queued frame, then the index and footer
+    void close();
+
+    size_t droppedFrames() const { return dropped; }
+
+private:
+    void run();
+
+    //Appends a chunk, storing data compressed if that makes it smaller
+    void writeChunk(recording::ChunkType type, int frameId, int rows, int cols, int cvType,
+                    const uint8_t *data, size_t size, size_t elementSize);
+
+    //Appends a chunk whose payload is already encoded
+    void writeEncodedChunk(const recording::ChunkHeader &header, const uint8_t *payload);
+
+    void append(const void *data, size_t size);
+
+    FILE *file;
+    uint64_t offset;
+    int compressionLevel;
+    size_t dropped;
+    bool failed;
+
+    std::vector<recording::IndexEntry> index;
+    BoundedQueue<std::unique_ptr<RecordingFrame>> queue;
+    std::thread ioThread;
+
+    //Scratch buffers reused between chunks
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> shuffled;
+    std::vector<uint8_t> compressed;
+};
+
+/* --- Recording Reader --- */
+/**
+\brief Random access to the frames of a recording
+The file is memory mapped and its index read once, after which seeking to
+any frame is a table lookup. Raw chunks are returned as views straight
+into the mapping, which is private, so writing through a view changes only
+this process's copy of the page and never the file. Compressed chunks are
+decoded into buffers owned by the reader. Either way what is returned is
+only valid until the next call for the same kind of chunk
+*/
+class RecordingReader {
+public:
+    //Points of a cloud chunk as the four planes they are stored in
+    struct CloudView {
+        const float *x;
+        const float *y;
+        const float *z;
+        const uint32_t *rgba;
+        int width;
+        int height;
+        size_t size() const { return static_cast<size_t>(width) * height; }
+    };
+
+    RecordingReader();
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    //Maps path and loads its index, rebuilding it from the chunks if the recording was never closed
+    bool open(const std::string &path);
+    void close();
+
+    //Number of frames, frame numbers are positions in the recording starting from 0
+    size_t size() const { return frames.size(); }
+
+    //Id the frame was written with
+    int frameId(size_t frame) const { return frames[frame].id; }
+
+    //Empty Mat or false if the frame has no chunk of that kind
+    cv::Mat rgb(size_t frame);
+    cv::Mat depth(size_t frame);
+    bool cloud(size_t frame, CloudView &view);
+
+    #if OBSTACLE_DETECTION
+    //Copies the frame's points into cloud, returns false if it has none
+    bool cloud(size_t frame, pcl::PointCloud<pcl::PointXYZRGB> &cloud);
+    #endif
+
+private:
+    struct FrameChunks {
+        int id;
+        const recording::ChunkHeader *chunks[4]; //indexed by ChunkType, null if missing
+    };
+
+    //Adds the chunk at offset to its frame's entry, returns false if it isn't a valid chunk
+    bool addChunk(uint64_t offset, std::map<int, size_t> &frameOf);
+
+    //Payload of chunk decoded to its raw bytes, in place if it is stored raw
+    const uint8_t* payload(const recording::ChunkHeader *chunk, std::vector<uint8_t> &buffer);
+
+    uint8_t *mapping;
+    size_t mappingSize;
+    std::vector<FrameChunks> frames;
+
+    //Decoded chunks handed out by the accessors, reused between frames
+    std::vector<uint8_t> depthBuffer;
+    std::vector<uint8_t> cloudBuffer;
+    std::vector<uint8_t> scratch;
+};
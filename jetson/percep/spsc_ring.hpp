@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/* --- SPSC Ring --- */
+/**
+\brief Lock-free ring of preallocated slots for one producer and one consumer
+The producer fills the slot acquire() gives it and hands it over with
+publish(), the consumer reads front() and gives the slot back with
+release(). Slots are reused in place so a slot holding a buffer, like a
+cv::Mat, keeps its memory between frames. Neither side ever blocks, a full
+or empty ring just returns nullptr
+*/
+template <typename T>
+class SpscRing {
+public:
+    //Capacity is rounded up to a power of two so positions wrap with a mask
+    explicit SpscRing(size_t capacity) : head{0}, tail{0} {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    size_t capacity() const { return slots.size(); }
+
+    //Number of published slots not yet released, exact only from the consumer
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    /* --- Producer --- */
+    //Next free slot to fill, nullptr if the ring is full
+    T* acquire() {
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position - tail.load(std::memory_order_acquire) == slots.size()) {
+            return nullptr;
+        }
+        return &slots[position & mask];
+    }
+
+    //Makes the slot from acquire() visible to the consumer
+    void publish() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /* --- Consumer --- */
+    //Oldest published slot, nullptr if the ring is empty
+    T* front() {
+        size_t position = tail.load(std::memory_order_relaxed);
+        if (position == head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[position & mask];
+    }
+
+    //Gives the slot from front() back to the producer
+    void release() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    //Positions only ever grow, padded onto separate cache lines so the two sides don't contend
+    //Padding rather than alignas since c++14 new ignores over-alignment
+    char headPadding[64];
+    std::atomic<size_t> head;
+    char tailPadding[64];
+    std::atomic<size_t> tail;
+    char endPadding[64];
+};
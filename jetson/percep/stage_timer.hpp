@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+
+/* --- Obstacle Detection Stages --- */
+//Stages of PCL::pcl_obstacle_detection that are timed every frame
+enum ObstacleStage {
+    STAGE_PASS_THROUGH,
+    STAGE_VOXEL,
+    STAGE_RANSAC,
+    STAGE_CLUSTERING,
+    STAGE_INTEREST_POINTS,
+    STAGE_CLEAR_PATH,
+    NUM_OBSTACLE_STAGES
+};
+
+const char* const OBSTACLE_STAGE_NAMES[NUM_OBSTACLE_STAGES] = {
+    "pass_through", "voxel", "ransac", "clustering", "interest_points", "clear_path"
+};
+
+/* --- Stage Timer --- */
+//Writes the milliseconds from construction until stop() or destruction to elapsed
+class StageTimer {
+public:
+    explicit StageTimer(double &elapsed) :
+        elapsed{elapsed}, start{std::chrono::steady_clock::now()}, running{true} {}
+
+    ~StageTimer() { stop(); }
+
+    void stop() {
+        if (running) {
+            elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            running = false;
+        }
+    }
+
+private:
+    double &elapsed;
+    std::chrono::steady_clock::time_point start;
+    bool running;
+};
@@ -0,0 +1,106 @@
+#include "tag_range.hpp"
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX__)
+    #include <immintrin.h>
+#endif
+
+TagRangeEstimator::TagRangeEstimator(double shrink, double trim, double tolerance) :
+    shrink{shrink}, trim{std::min(std::max(trim, 0.0), 0.5)}, tolerance{tolerance} {}
+
+void TagRangeEstimator::collect(const float *row, int first, int last) {
+    //A depth is valid if it is positive and finite, both compares are false for NaN
+    int x = first;
+#if defined(__AVX__)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 infinity = _mm256_set1_ps(INFINITY);
+    for (; x + 8 <= last; x += 8) {
+        __m256 d = _mm256_loadu_ps(row + x);
+        __m256 valid = _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ), _mm256_cmp_ps(d, infinity, _CMP_LT_OQ));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(valid));
+        while (mask) {
+            samples.push_back(row[x + __builtin_ctz(mask)]);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; x < last; ++x) {
+        if (row[x] > 0 && row[x] < INFINITY) {
+            samples.push_back(row[x]);
+        }
+    }
+}
+
+TagRangeEstimator::Range TagRangeEstimator::estimate(const cv::Mat &depth, const std::vector<cv::Point2f> &corners) {
+    Range range{0, 0};
+    if (corners.size() != 4 || depth.empty()) {
+        return range;
+    }
+
+    cv::Point2f center(0, 0);
+    for (const cv::Point2f &corner : corners) {
+        center += corner;
+    }
+    center = center * 0.25f;
+    cv::Point2f quad[4];
+    for (int i = 0; i < 4; ++i) {
+        quad[i] = center + (corners[i] - center) * static_cast<float>(shrink);
+    }
+
+    float top = quad[0].y, bottom = quad[0].y;
+    for (const cv::Point2f &corner : quad) {
+        top = std::min(top, corner.y);
+        bottom = std::max(bottom, corner.y);
+    }
+    int firstRow = std::max(static_cast<int>(std::ceil(top - 0.5f)), 0);
+    int lastRow = std::min(static_cast<int>(std::floor(bottom - 0.5f)), depth.rows - 1);
+
+    //Walk the rows whose pixel centers are inside the quad, reading the span between its edges
+    samples.clear();
+    size_t covered = 0;
+    for (int y = firstRow; y <= lastRow; ++y) {
+        float yc = y + 0.5f;
+        float left = INFINITY, right = -INFINITY;
+        for (int i = 0; i < 4; ++i) {
+            const cv::Point2f &a = quad[i], &b = quad[(i + 1) % 4];
+            if ((a.y <= yc) == (b.y <= yc)) {
+                continue;
+            }
+            float x = a.x + (yc - a.y) * (b.x - a.x) / (b.y - a.y);
+            left = std::min(left, x);
+            right = std::max(right, x);
+        }
+        int first = std::max(static_cast<int>(std::ceil(left - 0.5f)), 0);
+        int last = std::min(static_cast<int>(std::floor(right - 0.5f)) + 1, depth.cols);
+        if (first >= last) {
+            continue;
+        }
+        covered += last - first;
+        collect(depth.ptr<float>(y), first, last);
+    }
+    if (samples.empty()) {
+        return range;
+    }
+
+    //Trimmed mean of the middle of the samples, only the trimmed ends need to be partitioned off
+    size_t count = samples.size();
+    size_t low = static_cast<size_t>(trim * count);
+    size_t high = std::max(count - low, low + 1);
+    std::nth_element(samples.begin(), samples.begin() + low, samples.end());
+    if (high < count) {
+        std::nth_element(samples.begin() + low, samples.begin() + high, samples.end());
+    }
+    double sum = 0;
+    for (size_t i = low; i < high; ++i) {
+        sum += samples[i];
+    }
+    range.distance = static_cast<float>(sum / (high - low));
+
+    size_t agreeing = 0;
+    float window = static_cast<float>(tolerance) * range.distance;
+    for (float sample : samples) {
+        agreeing += std::fabs(sample - range.distance) <= window;
+    }
+    range.confidence = static_cast<float>(count) / covered * static_cast<float>(agreeing) / count;
+    return range;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/* --- Tag Range Estimator --- */
+/**
+\brief Estimates the distance to a tag from every depth pixel inside its quad
+The quad is shrunk toward its center so pixels on the border that see past the
+tag are left out. Each row of the quad is read as one span, NaN and infinite
+depths are dropped eight at a time, and the distance is a trimmed mean of the
+samples that are left. Confidence is the fraction of the quad that had valid
+depth times the fraction of those within tolerance of the estimate
+*/
+class TagRangeEstimator {
+public:
+    struct Range {
+        float distance;
+        float confidence;
+    };
+
+    //shrink scales the quad about its center, trim is the fraction dropped from each end of the
+    //sorted samples (0.5 gives the median), tolerance is relative to the estimated distance
+    TagRangeEstimator(double shrink, double trim, double tolerance);
+
+    //corners are the four corners of the tag in pixels, depth a CV_32FC1 image
+    //The distance is in the units of depth, confidence is 0 when there was no valid depth
+    Range estimate(const cv::Mat &depth, const std::vector<cv::Point2f> &corners);
+
+private:
+    //Appends the valid depths in row[first, last) to samples
+    void collect(const float *row, int first, int last);
+
+    double shrink;
+    double trim;
+    double tolerance;
+
+    std::vector<float> samples;
+};
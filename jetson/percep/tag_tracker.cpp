@@ -0,0 +1,94 @@
+#include "tag_tracker.hpp"
+#include <algorithm>
+
+TagTracker::TagTracker(double alpha, double beta, double rateDecay, int lifetime) :
+    alpha{alpha}, beta{beta}, rateDecay{rateDecay}, lifetime{lifetime}, lastUpdate{0}, updated{false} {}
+
+void TagTracker::clear() {
+    tracks.clear();
+    updated = false;
+}
+
+void TagTracker::update(const std::vector<rover_msgs::Target> &detections, int64_t time) {
+    //Frames are timed by when they were captured, however long they waited to be processed
+    double dt = updated ? (time - lastUpdate) / 1e6 : 0;
+    lastUpdate = time;
+    updated = true;
+
+    //Average detections with the same id into a single measurement
+    measurements.clear();
+    measurementCounts.clear();
+    for (const rover_msgs::Target &detection : detections) {
+        size_t m = 0;
+        while (m < measurements.size() && measurements[m].id != detection.id) {
+            ++m;
+        }
+        if (m == measurements.size()) {
+            measurements.push_back(detection);
+            measurementCounts.push_back(1);
+            continue;
+        }
+        int n = ++measurementCounts[m];
+        rover_msgs::Target &merged = measurements[m];
+        merged.distance += (detection.distance - merged.distance) / n;
+        merged.bearing += (detection.bearing - merged.bearing) / n;
+        for (int axis = 0; axis < 3; ++axis) {
+            merged.position[axis] += (detection.position[axis] - merged.position[axis]) / n;
+        }
+    }
+
+    //Predict every track forward, then correct the ones that were measured
+    //A tag is never predicted behind the camera, nav reads a negative distance as no tag
+    for (Track &track : tracks) {
+        track.target.distance = std::max(track.target.distance + track.distanceRate * dt, 0.0);
+        track.target.bearing += track.bearingRate * dt;
+        ++track.missed;
+    }
+    for (const rover_msgs::Target &measurement : measurements) {
+        auto track = std::find_if(tracks.begin(), tracks.end(), [&](const Track &t) {
+            return t.target.id == measurement.id;
+        });
+        if (track == tracks.end()) {
+            tracks.push_back(Track{measurement, 0, 0, 0});
+            continue;
+        }
+
+        double distanceResidual = measurement.distance - track->target.distance;
+        double bearingResidual = measurement.bearing - track->target.bearing;
+        track->target.distance += alpha * distanceResidual;
+        track->target.bearing += alpha * bearingResidual;
+        if (dt > 0) {
+            track->distanceRate += beta * distanceResidual / dt;
+            track->bearingRate += beta * bearingResidual / dt;
+        }
+
+        //The pose isn't filtered, the latest one is passed along
+        std::copy(measurement.position, measurement.position + 3, track->target.position);
+        std::copy(measurement.rotation, measurement.rotation + 3, track->target.rotation);
+        track->missed = 0;
+    }
+
+    //Tracks that are coasting slow down so a noisy rate can't carry them far
+    for (Track &track : tracks) {
+        if (track.missed > 0) {
+            track.distanceRate *= rateDecay;
+            track.bearingRate *= rateDecay;
+        }
+    }
+
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(), [this](const Track &track) {
+        return track.missed > lifetime;
+    }), tracks.end());
+}
+
+void TagTracker::fill(rover_msgs::TargetList &targets) const {
+    targets.targetList.clear();
+    for (const Track &track : tracks) {
+        targets.targetList.push_back(track.target);
+    }
+    std::sort(targets.targetList.begin(), targets.targetList.end(),
+              [](const rover_msgs::Target &a, const rover_msgs::Target &b) {
+        return a.bearing < b.bearing;
+    });
+    targets.num_targets = static_cast<int32_t>(targets.targetList.size());
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "rover_msgs/TargetList.hpp"
+
+/* --- Tag Tracker --- */
+/**
+\brief Smooths AR tag distance and bearing over time, one track per tag id
+Each track runs an alpha-beta filter on distance and bearing. Tags that stop
+being detected keep coasting on their last rates, which shrink by rateDecay
+every frame they are missed, for up to lifetime frames before the track is
+dropped, so a tag hidden for a few frames is still sent.
+Detections that share an id, such as two faces of one post, are averaged
+into one measurement
+*/
+class TagTracker {
+public:
+    //alpha and beta are the filter gains, lifetime is how many frames in a row a track can miss
+    TagTracker(double alpha, double beta, double rateDecay, int lifetime);
+
+    //Updates the tracks with this frame's detections, captured at time in microseconds since the epoch
+    void update(const std::vector<rover_msgs::Target> &detections, int64_t time);
+
+    //Fills targets with every live track, ordered left to right
+    void fill(rover_msgs::TargetList &targets) const;
+
+    //Drops every track
+    void clear();
+
+private:
+    struct Track {
+        rover_msgs::Target target;
+        double distanceRate;
+        double bearingRate;
+        int missed;
+    };
+
+    double alpha;
+    double beta;
+    double rateDecay;
+    int lifetime;
+
+    std::vector<Track> tracks;
+    int64_t lastUpdate;
+    bool updated;
+
+    //Detections merged by id, reused between frames
+    std::vector<rover_msgs::Target> measurements;
+    std::vector<int> measurementCounts;
+};
@@ -0,0 +1,106 @@
+#include "telemetry.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const char* const TELEMETRY_STAGE_NAMES[TELEMETRY_POINT_CLOUD] = {
+        "capture", "ar_tags", "obstacles", "occupancy_grid"
+    };
+
+    //Nearest rank percentile, reorders samples
+    double percentile(std::vector<float> &samples, double fraction) {
+        size_t rank = static_cast<size_t>(std::ceil(fraction * samples.size()));
+        auto nth = samples.begin() + (rank > 0 ? rank - 1 : 0);
+        std::nth_element(samples.begin(), nth, samples.end());
+        return *nth;
+    }
+}
+
+Telemetry::Telemetry(const rapidjson::Document &config) :
+    PERIOD{config["telemetry"]["period"].GetDouble()},
+    droppedFrames{0}, lastDroppedFrames{0}, windowStart{std::chrono::steady_clock::now()} {
+    const size_t RING_SIZE = config["telemetry"]["ring_size"].GetInt();
+    for (int lane = 0; lane < NUM_TELEMETRY_LANES; ++lane) {
+        lanes.emplace_back(new Lane(RING_SIZE));
+    }
+    for (StageWindow &window : windows) {
+        window.ms.reserve(RING_SIZE);
+    }
+}
+
+void Telemetry::record(TelemetryLane lane, int stage, double ms, int pointsIn, int pointsOut) {
+    Lane &target = *lanes[lane];
+    Span *span = target.ring.acquire();
+    if (!span) {
+        target.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    *span = Span{stage, static_cast<float>(ms), pointsIn, pointsOut};
+    target.ring.publish();
+}
+
+bool Telemetry::poll(rover_msgs::PerceptionTelemetry &message) {
+    for (const std::unique_ptr<Lane> &lane : lanes) {
+        while (const Span *span = lane->ring.front()) {
+            StageWindow &window = windows[span->stage];
+            window.ms.push_back(span->ms);
+            if (span->pointsIn >= 0) {
+                window.pointsIn += span->pointsIn;
+                ++window.pointsInCount;
+            }
+            if (span->pointsOut >= 0) {
+                window.pointsOut += span->pointsOut;
+                ++window.pointsOutCount;
+            }
+            lane->ring.release();
+        }
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double window = std::chrono::duration<double>(now - windowStart).count();
+    if (window < PERIOD) {
+        return false;
+    }
+    summarize(message, window);
+    windowStart = now;
+    return true;
+}
+
+void Telemetry::summarize(rover_msgs::PerceptionTelemetry &message, double window) {
+    message.window_s = window;
+    message.frames = static_cast<int32_t>(windows[TELEMETRY_CAPTURE].ms.size());
+
+    unsigned dropped = droppedFrames.load(std::memory_order_relaxed);
+    message.dropped_frames = static_cast<int32_t>(dropped - lastDroppedFrames);
+    lastDroppedFrames = dropped;
+
+    message.dropped_spans = 0;
+    for (const std::unique_ptr<Lane> &lane : lanes) {
+        message.dropped_spans += lane->dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    //Only stages that ran show up, the depth engine never records the point cloud stages
+    message.stages.clear();
+    for (int stage = 0; stage < NUM_TELEMETRY_STAGES; ++stage) {
+        StageWindow &samples = windows[stage];
+        if (samples.ms.empty()) {
+            continue;
+        }
+
+        rover_msgs::PerceptionStage summary;
+        summary.name = stage < TELEMETRY_POINT_CLOUD ? TELEMETRY_STAGE_NAMES[stage]
+                                                     : OBSTACLE_STAGE_NAMES[stage - TELEMETRY_POINT_CLOUD];
+        summary.count = static_cast<int32_t>(samples.ms.size());
+        summary.p50_ms = percentile(samples.ms, 0.5);
+        summary.p95_ms = percentile(samples.ms, 0.95);
+        summary.max_ms = *std::max_element(samples.ms.begin(), samples.ms.end());
+        summary.points_in = samples.pointsInCount ? samples.pointsIn / samples.pointsInCount : -1;
+        summary.points_out = samples.pointsOutCount ? samples.pointsOut / samples.pointsOutCount : -1;
+        message.stages.push_back(summary);
+
+        samples.ms.clear();
+        samples.pointsIn = samples.pointsOut = 0;
+        samples.pointsInCount = samples.pointsOutCount = 0;
+    }
+    message.num_stages = static_cast<int32_t>(message.stages.size());
+}
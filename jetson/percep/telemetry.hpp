@@ -0,0 +1,94 @@
+#pragma once
+
+#include "spsc_ring.hpp"
+#include "stage_timer.hpp"
+#include "rapidjson/document.h"
+#include "rover_msgs/PerceptionTelemetry.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+/* --- Telemetry Stages --- */
+//Everything perception records spans for, the point cloud stages follow in ObstacleStage order
+enum TelemetryStage {
+    TELEMETRY_CAPTURE,
+    TELEMETRY_AR_TAGS,
+    TELEMETRY_OBSTACLES,
+    TELEMETRY_OCCUPANCY_GRID,
+    TELEMETRY_POINT_CLOUD,
+    NUM_TELEMETRY_STAGES = TELEMETRY_POINT_CLOUD + NUM_OBSTACLE_STAGES
+};
+
+//Threads that record spans, each one writes into a ring of its own
+enum TelemetryLane {
+    LANE_CAPTURE,
+    LANE_AR_TAGS,
+    LANE_OBSTACLES,
+    NUM_TELEMETRY_LANES
+};
+
+/* --- Telemetry --- */
+/**
+\brief Per-stage latency and point counts, summarized for the base station
+Stages time themselves with StageTimer and record() the span into their
+thread's lane, an SpscRing only that thread writes, so recording never
+locks or allocates and a full lane drops the span and counts it. The
+publishing thread drains every lane with poll() and once every PERIOD
+seconds turns what it collected into p50, p95 and max latency and the mean
+points in and out of each stage, along with frames the camera dropped
+*/
+class Telemetry {
+public:
+    //Seconds between summaries
+    double PERIOD;
+
+    //Reads telemetry
+    Telemetry(const rapidjson::Document &config);
+
+    /* --- Producers --- */
+    //Records a span of stage that took ms, from lane's own thread only
+    //Points are -1 for stages that don't count them
+    void record(TelemetryLane lane, int stage, double ms, int pointsIn = -1, int pointsOut = -1);
+
+    //Frames the camera has dropped since it opened, kept current by the capture thread
+    void setDroppedFrames(unsigned count) { droppedFrames.store(count, std::memory_order_relaxed); }
+
+    /* --- Consumer --- */
+    //Drains the lanes, returns true with message filled in when a summary is due
+    bool poll(rover_msgs::PerceptionTelemetry &message);
+
+private:
+    struct Span {
+        int stage;
+        float ms;
+        int pointsIn;
+        int pointsOut;
+    };
+
+    //SpscRing holds atomics so lanes stay where they were built
+    struct Lane {
+        explicit Lane(size_t capacity) : ring{capacity}, dropped{0} {}
+
+        SpscRing<Span> ring;
+        std::atomic<int> dropped;
+    };
+
+    //What the consumer collected for a stage since the last summary
+    struct StageWindow {
+        std::vector<float> ms;
+        double pointsIn = 0;
+        int pointsInCount = 0;
+        double pointsOut = 0;
+        int pointsOutCount = 0;
+    };
+
+    void summarize(rover_msgs::PerceptionTelemetry &message, double window);
+
+    std::vector<std::unique_ptr<Lane>> lanes;
+    std::atomic<unsigned> droppedFrames;
+
+    StageWindow windows[NUM_TELEMETRY_STAGES];
+    unsigned lastDroppedFrames;
+    std::chrono::steady_clock::time_point windowStart;
+};
@@ -0,0 +1,58 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(int numThreads) :
+    task{nullptr}, generation{0}, remaining{0}, stopping{false} {
+    for (int i = 1; i < numThreads; ++i) {
+        workers.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(const std::function<void(int)> &task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        remaining = static_cast<int>(workers.size());
+        ++generation;
+    }
+    started.notify_all();
+
+    task(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return remaining == 0; });
+    this->task = nullptr;
+}
+
+void ThreadPool::work(int index) {
+    unsigned seen = 0;
+    while (true) {
+        const std::function<void(int)> *current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            current = task;
+        }
+
+        (*current)(index);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--remaining == 0) {
+            finished.notify_one();
+        }
+    }
+}
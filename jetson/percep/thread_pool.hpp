@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* --- Thread Pool --- */
+/**
+\brief Fixed set of threads that run one task per thread at a time
+run() hands every thread its index and blocks until all of them are done,
+the calling thread takes index 0 so a pool of size n only starts n - 1
+threads. Work is split by index up front, so which thread does what never
+depends on timing
+*/
+class ThreadPool {
+public:
+    explicit ThreadPool(int numThreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    //Runs task(i) for every i in [0, size()), returns once they have all finished
+    void run(const std::function<void(int)> &task);
+
+private:
+    void work(int index);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+
+    //Task of the current run, generation counts runs so workers know when a new one starts
+    const std::function<void(int)> *task;
+    unsigned generation;
+    int remaining;
+    bool stopping;
+};
@@ -85,40 +85,20 @@ export default class TargetDetector {
     /* Step 2: Sort visible posts from left to right */
     this.visiblePosts.sort((post1:ArTag, post2:ArTag) => arTagCompare(this.zedOdom, post1, post2));
 
-    /* Step 3: get first entry in target list (left most post) */
-    let targetLeft:TargetMessage = {
-      bearing: 0,
-      distance: -1,
-      id: -1
-    };
-    if (this.visiblePosts.length) {
-      const [leftDist, leftBear]:[number, number] = calcDistAndBear(this.zedOdom,
-                                                                    this.visiblePosts[0].odom);
-      targetLeft = {
-        bearing: calcRelativeBearing(this.zedOdom.bearing_deg, radToDeg(leftBear)),
-        distance: leftDist,
-        id: this.visiblePosts[0].id
+    /* Step 3: create a target for every visible post */
+    return this.visiblePosts.map((post:ArTag):TargetMessage => {
+      const [dist, bear]:[number, number] = calcDistAndBear(this.zedOdom, post.odom);
+      const bearing:number = calcRelativeBearing(this.zedOdom.bearing_deg, radToDeg(bear));
+
+      /* Posts are treated as facing the rover so only the position is simulated. */
+      return {
+        bearing,
+        distance: dist,
+        id: post.id,
+        position: [dist * Math.sin(degToRad(bearing)), 0, dist * Math.cos(degToRad(bearing))],
+        rotation: [0, 0, 0]
       };
-    }
-
-    /* Step 4: get second entry in target list (right most post) */
-    let targetRight:TargetMessage = {
-      bearing: 0,
-      distance: -1,
-      id: -1
-    };
-    if (this.visiblePosts.length > 1) {
-      const lastIndex:number = this.visiblePosts.length - 1;
-      const [rightDist, rightBear]:[number, number] =
-          calcDistAndBear(this.zedOdom, this.visiblePosts[lastIndex].odom);
-      targetRight = {
-        bearing: calcRelativeBearing(this.zedOdom.bearing_deg, radToDeg(rightBear)),
-        distance: rightDist,
-        id: this.visiblePosts[lastIndex].id
-      };
-    }
-
-    return [targetLeft, targetRight];
+    });
   } /* computeTargetList() */
 
   /* Update posts list on change. */
@@ -46,18 +46,7 @@ const state:RoverState = {
 
   radioSignalStrength: 100,
 
-  targetList: [
-    {
-      distance: -1,
-      bearing: 0,
-      id: -1
-    },
-    {
-      distance: -1,
-      bearing: 0,
-      id: -1
-    }
-  ],
+  targetList: [],
 
   zedGimbalCmd: {
     angle: 0
@@ -293,12 +293,15 @@ export interface TargetMessage {
   bearing:number; /* degrees from rover's heading */
   distance:number; /* meters from rover */
   id:number;
+  position:[number, number, number]; /* meters in the camera frame (x right, y down, z forward) */
+  rotation:[number, number, number]; /* Rodrigues vector in the camera frame */
 }
 
 
 /* Type representing the TargetList LCM. This must be the same as the
-   TargetList LCM. */
-export type TargetListMessage = [TargetMessage, TargetMessage];
+   targetList array of the TargetList LCM (i.e. every visible target ordered
+   left to right). */
+export type TargetListMessage = TargetMessage[];
 
 
 /* Interface representing the Waypoint LCM. This must be the same as the